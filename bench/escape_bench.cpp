@@ -0,0 +1,126 @@
+/*
+    c2ffi
+    Copyright (C) 2013  Ryan Pavlik
+
+    This file is part of c2ffi.
+
+    c2ffi is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    c2ffi is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Compares json_escape_scan with the scalar loop it replaced, over
+   strings the size of names, paths and long values.  Built with
+   -DC2FFI_BUILD_BENCHMARKS=ON; run bin/escape_bench [iterations]. */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "c2ffi/escape.h"
+
+using namespace c2ffi;
+
+typedef size_t (*ScanFn)(const char *, size_t);
+
+static volatile size_t sink;
+
+// Nanoseconds per byte over all of the strings
+static double run(ScanFn scan, const std::vector<std::string> &strs,
+                  long iterations) {
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for (long n = 0; n < iterations; n++) {
+        for (const std::string &s : strs) {
+            // Scan the way the json driver does, past each escape
+            size_t i = 0;
+
+            while (i < s.size()) {
+                i += scan(s.data() + i, s.size() - i) + 1;
+                sink = i;
+            }
+
+            bytes += s.size();
+        }
+    }
+
+    std::chrono::duration<double, std::nano> t =
+            std::chrono::steady_clock::now() - start;
+
+    return t.count() / bytes;
+}
+
+static std::vector<std::string> make(size_t len, size_t count, bool escapes) {
+    std::vector<std::string> v;
+
+    for (size_t i = 0; i < count; i++) {
+        std::string s;
+
+        for (size_t j = 0; j < len; j++)
+            s += (char) ('a' + (i + j) % 26);
+
+        // One quote in the middle, as in a string literal's value
+        if (escapes) s[len / 2] = '"';
+
+        v.push_back(s);
+    }
+
+    return v;
+}
+
+int main(int argc, char *argv[]) {
+    long iterations = argc > 1 ? atol(argv[1]) : 2000;
+
+    if (iterations <= 0) {
+        std::cerr << "Error: usage: escape_bench [iterations]" << std::endl;
+        exit(1);
+    }
+
+    static const struct {
+        const char *what;
+        size_t len;
+        bool escapes;
+    } cases[] = {
+            {"name", 12, false},
+            {"path", 60, false},
+            {"path, escaped", 60, true},
+            {"value", 1024, false},
+            {"value, escaped", 1024, true},
+    };
+
+    printf("%-16s %12s %12s %8s\n", "strings", "scalar ns/B", "simd ns/B",
+           "speedup");
+
+    for (const auto &c : cases) {
+        std::vector<std::string> strs = make(c.len, 1000, c.escapes);
+
+        for (const std::string &s : strs) {
+            if (json_escape_scan(s.data(), s.size()) !=
+                json_escape_scan_scalar(s.data(), s.size())) {
+                std::cerr << "Error: scans disagree on " << c.what << std::endl;
+                exit(1);
+            }
+        }
+
+        double scalar = run(json_escape_scan_scalar, strs, iterations);
+        double simd = run(json_escape_scan, strs, iterations);
+
+        printf("%-16s %12.3f %12.3f %7.2fx\n", c.what, scalar, simd,
+               scalar / simd);
+    }
+
+    return 0;
+}
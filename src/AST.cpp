@@ -20,9 +20,13 @@
 
 #include <iostream>
 #include <map>
+#include <vector>
 
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
 #include <llvm/ADT/IntrusiveRefCntPtr.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringExtras.h>
 
 #include <clang/Basic/DiagnosticOptions.h>
 #include <clang/Lex/HeaderSearch.h>
@@ -30,10 +34,13 @@
 #include <clang/AST/ASTContext.h>
 #include <clang/AST/DeclTemplate.h>
 #include <clang/AST/RecordLayout.h>
+#include <clang/Index/USRGeneration.h>
 #include <clang/Parse/Parser.h>
 
 #include "c2ffi.h"
 #include "c2ffi/ast.h"
+#include "c2ffi/deps.h"
+#include "c2ffi/fingerprint.h"
 
 using namespace c2ffi;
 
@@ -52,79 +59,203 @@ static std::string value_to_string(clang::APValue *v) {
     return s;
 }
 
-Decl *C2FFIASTConsumer::proc(const clang::Decl *d, Decl *decl) {
-    if (!decl) return nullptr;
+void C2FFIASTConsumer::proc(const clang::Decl *d, Decl *decl) {
+    if (!decl) return;
 
     decl->set_ns(add_decl(_ns));
 
-    if (decl->location().empty())
+    if (!decl->file() && decl->spelled_location().empty())
         decl->set_location(_ci, d);
 
+    if (decl->usr().empty())
+        decl->set_usr(usr(d));
+
+    if (_config.fingerprints)
+        decl->set_fingerprint(_fingerprint(*decl));
+
+    emit(decl);
+}
+
+void C2FFIASTConsumer::emit(Decl *decl) {
+    if (_base) {
+        if (_base_mid) _config.base_od->write_between();
+        else _base_mid = true;
+
+        _config.base_od->write_decl(*decl);
+        delete decl;
+        return;
+    }
+
+    if (_held) {
+        _held->push_back(decl);
+        return;
+    }
+
+    if (_pipeline) {
+        _pipeline->push(decl);
+        return;
+    }
+
     if (_mid) _od->write_between();
     else _mid = true;
 
-    _od->write(*decl);
-    return decl;
+    _od->write_decl(*decl);
+    delete decl;
 }
 
-#define PROC decl = proc(d, make_decl(x))
+namespace {
+    /* One entry per clang::Decl::Kind; `kind' is the --kinds bit the
+       declaration falls under, a null handler means it is never
+       output. */
+    struct DeclDispatch {
+        unsigned int kind;
+        DeclHandler handler;
+        bool is_context;
+    };
+
+    enum {
+        NumDeclKinds = 0
+#define DECL(DERIVED, BASE) + 1
+#define ABSTRACT_DECL(DECL)
+#include <clang/AST/DeclNodes.inc>
+    };
+}
 
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wshadow"
-#pragma clang diagnostic ignored "-Wunused-variable"
+template<typename T>
+static void proc_decl(C2FFIASTConsumer *ast, clang::Decl *d) {
+    ast->proc(d, ast->make_decl(llvm::cast<T>(d)));
+}
 
-void C2FFIASTConsumer::HandleDecl(clang::Decl *d, const clang::NamedDecl *ns) {
-    Decl *decl = nullptr;
-    const clang::NamedDecl *old_ns = _ns;
-    _ns = ns;
+template<typename T>
+static DeclDispatch dispatch(unsigned int kind, bool is_context = false) {
+    return {kind, &proc_decl<T>, is_context};
+}
+
+static DeclDispatch skip() {
+    return {0, nullptr, false};
+}
+
+/* Order is important here, the first matching class wins */
+static DeclDispatch classify(clang::Decl::Kind k) {
+    if (clang::NamespaceDecl::classofKind(k)) return dispatch<clang::NamespaceDecl>(kind_namespace, true);
+    if (clang::VarDecl::classofKind(k)) return dispatch<clang::VarDecl>(kind_var);
+
+    /* C/C++ */
+    if (clang::FieldDecl::classofKind(k)) return skip();
+    if (clang::IndirectFieldDecl::classofKind(k)) return skip();
+    if (clang::CXXMethodDecl::classofKind(k)) return skip();
+    if (clang::FunctionTemplateDecl::classofKind(k)) return skip();
+    if (clang::FunctionDecl::classofKind(k)) return dispatch<clang::FunctionDecl>(kind_function);
+    if (clang::CXXRecordDecl::classofKind(k)) return dispatch<clang::CXXRecordDecl>(kind_record, true);
+    if (clang::RecordDecl::classofKind(k)) return dispatch<clang::RecordDecl>(kind_record, true);
+    if (clang::EnumDecl::classofKind(k)) return dispatch<clang::EnumDecl>(kind_enum);
+    if (clang::TypedefDecl::classofKind(k)) return dispatch<clang::TypedefDecl>(kind_typedef);
+    if (clang::ClassTemplateDecl::classofKind(k)) return skip();
+    if (clang::TypeAliasDecl::classofKind(k)) return dispatch<clang::TypeAliasDecl>(kind_type_alias);
+    if (clang::TypeAliasTemplateDecl::classofKind(k)) return dispatch<clang::TypeAliasTemplateDecl>(kind_type_alias);
+    if (clang::VarTemplateDecl::classofKind(k)) return dispatch<clang::VarTemplateDecl>(kind_var);
+    if (clang::UsingDecl::classofKind(k)) return dispatch<clang::UsingDecl>(kind_using);
+    if (clang::UsingShadowDecl::classofKind(k)) return dispatch<clang::UsingShadowDecl>(kind_using);
+    if (clang::UsingDirectiveDecl::classofKind(k)) return dispatch<clang::UsingDirectiveDecl>(kind_using);
+
+    /* ObjC */
+    if (clang::ObjCInterfaceDecl::classofKind(k)) return dispatch<clang::ObjCInterfaceDecl>(kind_objc);
+    if (clang::ObjCCategoryDecl::classofKind(k)) return dispatch<clang::ObjCCategoryDecl>(kind_objc);
+    if (clang::ObjCProtocolDecl::classofKind(k)) return dispatch<clang::ObjCProtocolDecl>(kind_objc);
+    if (clang::ObjCImplementationDecl::classofKind(k)) return skip();
+    if (clang::ObjCMethodDecl::classofKind(k)) return skip();
+
+    /* Always should be last */
+    if (clang::NamedDecl::classofKind(k)) return dispatch<clang::NamedDecl>(kind_unhandled);
+
+    return skip();
+}
+
+static const std::vector<DeclDispatch> &dispatch_table() {
+    static std::vector<DeclDispatch> table = [] {
+        std::vector<DeclDispatch> v;
+
+        for (int k = 0; k < NumDeclKinds; k++)
+            v.push_back(classify((clang::Decl::Kind) k));
+
+        return v;
+    }();
+
+    return table;
+}
 
+// The dispatch table goes by clang kind, which a struct, union and
+// class share
+static unsigned int record_kind(const clang::RecordDecl *d) {
+    if (d->isUnion()) return kind_union;
+    if (d->isClass()) return kind_class;
+
+    return kind_struct;
+}
+
+void C2FFIASTConsumer::HandleDecl(clang::Decl *d, const clang::NamedDecl *ns) {
     if (d->isInvalidDecl()) {
         std::cerr << "Skipping invalid Decl:" << std::endl;
         d->dump();
         return;
     }
 
-    if_cast(x, clang::NamespaceDecl, d) {
-        PROC;
-        HandleNS(x);
-    } else if_cast(x, clang::VarDecl, d) PROC;
-        /* C/C++ */
-    else if_cast(x, clang::FieldDecl, d);
-    else if_cast(x, clang::IndirectFieldDecl, d);
-    else if_cast(x, clang::CXXMethodDecl, d);
-    else if_cast(x, clang::FunctionTemplateDecl, d);
-    else if_cast(x, clang::FunctionDecl, d) PROC;
-    else if_cast(x, clang::CXXRecordDecl, d) {
-        PROC;
-        HandleDeclContext(x, x);
-    } else if_cast(x, clang::RecordDecl, d) {
-        PROC;
-        HandleDeclContext(x, x);
-    } else if_cast(x, clang::EnumDecl, d) PROC;
-    else if_cast(x, clang::TypedefDecl, d) PROC;
-    else if_cast(x, clang::ClassTemplateDecl, d);
-    else if_cast(x, clang::TypeAliasDecl, d) PROC;
-    else if_cast(x, clang::TypeAliasTemplateDecl, d) PROC;
-    else if_cast(x, clang::VarTemplateDecl, d) PROC;
-    else if_cast(x, clang::UsingDecl, d) PROC;
-    else if_cast(x, clang::UsingShadowDecl, d) PROC;
-    else if_cast(x, clang::UsingDirectiveDecl, d) PROC;
-        /* ObjC */
-    else if_cast(x, clang::ObjCInterfaceDecl, d) PROC;
-    else if_cast(x, clang::ObjCCategoryDecl, d) PROC;
-    else if_cast(x, clang::ObjCProtocolDecl, d) PROC;
-    else if_cast(x, clang::ObjCImplementationDecl, d);
-    else if_cast(x, clang::ObjCMethodDecl, d);
-
-        /* Always should be last */
-    else if_cast(x, clang::NamedDecl, d) PROC;
-    else decl = make_decl(d);
+    const DeclDispatch &dd = dispatch_table()[d->getKind()];
+    const clang::NamedDecl *old_ns = _ns;
+    _ns = ns;
+
+    unsigned int kind = dd.kind;
+    if (kind == kind_record)
+        kind = record_kind(llvm::cast<clang::RecordDecl>(d));
+
+    if (dd.handler && (_config.decl_kinds & kind) &&
+        _config.filter.accept(_ci.getSourceManager(), d)) {
+        if (defer_output())
+            _deferred.push_back({d, _ns, dd.handler});
+        else
+            process(d, dd.handler);
+    }
+
+    if (dd.is_context)
+        HandleDeclContext(llvm::cast<clang::DeclContext>(d),
+                          llvm::cast<clang::NamedDecl>(d));
 
-    delete decl;
     _ns = old_ns;
 }
 
-#pragma clang diagnostic pop
+void C2FFIASTConsumer::process(clang::Decl *d, DeclHandler handler) {
+    if (to_base(d)) {
+        // With --use-base-spec it is already in the base
+        if (!_config.base_od) return;
+
+        _base = true;
+        handler(this, d);
+        _base = false;
+        return;
+    }
+
+    write_deps(d);
+
+    // Nothing would be written (-D null); -T still needs the types seen
+    if (!_od->writes_decls() && !_config.template_output) return;
+
+    handler(this, d);
+}
+
+void C2FFIASTConsumer::process(const DeferredDecl &dd) {
+    _ns = dd.ns;
+    process(dd.d, dd.handler);
+}
+
+bool C2FFIASTConsumer::to_base(const clang::Decl *d) const {
+    return !_config.base_spec.empty() &&
+           _config.filter.is_system(_ci.getSourceManager(), d->getLocation());
+}
+
+void C2FFIASTConsumer::write_deps(const clang::Decl *d) {
+    if (_deps)
+        write_decl_deps(*_deps, _ci.getSourceManager(), d);
+}
 
 void C2FFIASTConsumer::HandleNS(const clang::NamespaceDecl *ns) {
     HandleDeclContext(ns, ns);
@@ -147,6 +278,181 @@ bool C2FFIASTConsumer::HandleTopLevelDecl(clang::DeclGroupRef d) {
     return true;
 }
 
+void C2FFIASTConsumer::HandleTranslationUnit(clang::ASTContext &ctx) {
+    if (defer_output())
+        EmitDeferred();
+
+    if (_deps)
+        _deps->flush();
+}
+
+static bool is_root(const std::vector<llvm::GlobPattern> &roots,
+                    const clang::Decl *d) {
+    llvm::StringRef name = identifier_name(llvm::dyn_cast<clang::NamedDecl>(d));
+
+    if (name.empty()) return false;
+
+    for (auto &root : roots)
+        if (root.match(name)) return true;
+
+    return false;
+}
+
+namespace {
+    // A step of --toposort output: a deferred declaration, or a
+    // forward declaration of one
+    struct SortedDecl {
+        const DeferredDecl *dd;
+        bool forward;
+    };
+}
+
+// What d must come after: the declarations it refers to, and the
+// namespaces it is in
+static void sort_deps(const clang::Decl *d, ClangDeclVector &out) {
+    decl_deps(decl_definition(d), out);
+
+    for (const clang::DeclContext *dc = d->getDeclContext(); dc;
+         dc = dc->getParent())
+        if_const_cast(nd, clang::NamespaceDecl, dc)
+            out.push_back(nd);
+}
+
+/* Depth-first, writing each declaration (with its redeclarations) once
+   everything it refers to is written.  A declaration reached again
+   while its own dependencies are still being written is part of a
+   cycle, and is forward declared there.  A record referring to itself
+   needs no forward declaration. */
+static std::vector<SortedDecl> toposort(const std::vector<const DeferredDecl *> &decls) {
+    struct Frame {
+        const clang::Decl *d;
+        ClangDeclVector deps;
+        size_t next;
+    };
+
+    std::map<const clang::Decl *, std::vector<const DeferredDecl *>> entries;
+    // 1 while on the stack, 2 once written
+    std::map<const clang::Decl *, int> state;
+    ClangDeclSet forwarded;
+    std::vector<Frame> stack;
+    std::vector<SortedDecl> out;
+
+    for (auto *dd : decls)
+        entries[dd->d->getCanonicalDecl()].push_back(dd);
+
+    auto push = [&](const clang::Decl *d) {
+        state[d] = 1;
+        stack.push_back({d, ClangDeclVector(), 0});
+        sort_deps(d, stack.back().deps);
+    };
+
+    for (auto *dd : decls) {
+        if (state[dd->d->getCanonicalDecl()])
+            continue;
+
+        push(dd->d->getCanonicalDecl());
+
+        while (!stack.empty()) {
+            Frame &f = stack.back();
+
+            if (f.next < f.deps.size()) {
+                const clang::Decl *dep = f.deps[f.next++]->getCanonicalDecl();
+                auto e = entries.find(dep);
+
+                // Not output at all
+                if (dep == f.d || e == entries.end())
+                    continue;
+
+                int s = state[dep];
+
+                if (!s)
+                    push(dep);
+                else if (s == 1 && forwarded.insert(dep).second)
+                    out.push_back({e->second.front(), true});
+
+                continue;
+            }
+
+            for (auto *x : entries[f.d])
+                out.push_back({x, false});
+
+            state[f.d] = 2;
+            stack.pop_back();
+        }
+    }
+
+    return out;
+}
+
+/* Everything reachable from the roots through the types make_type
+   resolves is output, in the original order.  Every redeclaration of a
+   reached declaration is output, so forward declarations stay.  With
+   --toposort, everything (or everything reached) is output in
+   dependency order instead. */
+void C2FFIASTConsumer::EmitDeferred() {
+    std::vector<const DeferredDecl *> decls;
+
+    if (_config.roots.empty()) {
+        for (auto &dd : _deferred)
+            decls.push_back(&dd);
+    } else {
+        ClangDeclSet reached;
+        ClangDeclVector work;
+
+        for (auto &dd : _deferred)
+            if (is_root(_config.roots, dd.d))
+                work.push_back(dd.d);
+
+        while (!work.empty()) {
+            const clang::Decl *d = work.back();
+            work.pop_back();
+
+            if (!reached.insert(d->getCanonicalDecl()).second)
+                continue;
+
+            sort_deps(d, work);
+        }
+
+        for (auto &dd : _deferred)
+            if (reached.count(dd.d->getCanonicalDecl()))
+                decls.push_back(&dd);
+    }
+
+    if (_config.toposort) {
+        for (auto &sd : toposort(decls)) {
+            _ns = sd.dd->ns;
+
+            if (sd.forward)
+                forward(sd.dd->d);
+            else
+                process(sd.dd->d, sd.dd->handler);
+        }
+    } else if (_config.incremental) {
+        _config.incremental->emit(*this, decls);
+    } else {
+        for (auto *dd : decls)
+            process(*dd);
+    }
+
+    _ns = nullptr;
+    _deferred.clear();
+}
+
+void C2FFIASTConsumer::forward(const clang::Decl *d) {
+    // It is written to the base spec, not here
+    if (!_config.base_spec.empty() &&
+        _config.filter.is_system(_ci.getSourceManager(), d->getLocation()))
+        return;
+
+    const auto *nd = llvm::dyn_cast<clang::NamedDecl>(d);
+    auto *fd = new ForwardDecl(nd ? nd->getDeclName().getAsString() : "",
+                               decl_kind_name(d));
+
+    // As a RecordType referring to it would have
+    fd->set_id(add_cxx_decl(decl_definition(d)));
+    proc(d, fd);
+}
+
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wunused-variable"
 
@@ -209,7 +515,7 @@ Decl *C2FFIASTConsumer::make_decl(const clang::VarDecl *d) {
     clang::APValue *v = nullptr;
     std::string name = d->getDeclName().getAsString();
     std::string value;
-    std::string loc;
+    clang::SourceLocation loc;
     bool is_string = false;
 
     if (name.substr(0, 8) == "__c2ffi_") {
@@ -220,7 +526,7 @@ Decl *C2FFIASTConsumer::make_decl(const clang::VarDecl *d) {
         const clang::MacroInfo *mi = pp.getMacroInfo(&ii);
 
         if (mi)
-            loc = mi->getDefinitionLoc().printToString(_ci.getSourceManager());
+            loc = mi->getDefinitionLoc();
     }
 
     if (d->hasInit()) {
@@ -255,8 +561,7 @@ Decl *C2FFIASTConsumer::make_decl(const clang::VarDecl *d) {
     Type *t = Type::make_type(this, d->getTypeSourceInfo()->getType().getTypePtr());
     auto *cv = new VarDecl(name, t, value, d->hasExternalStorage(), is_string);
 
-    if (!loc.empty())
-        cv->set_location(loc);
+    cv->set_location(_ci, loc);
 
     return cv;
 }
@@ -408,13 +713,89 @@ Decl *C2FFIASTConsumer::make_decl(const clang::ObjCProtocolDecl *d) {
     return r;
 }
 
-unsigned int C2FFIASTConsumer::decl_id(const clang::Decl *d) const {
+unsigned int C2FFIASTConsumer::add_decl(const clang::Decl *d) {
+    if (!d) return 0;
+
     auto it = _decl_map.find(d);
+    unsigned int id;
 
     if (it != _decl_map.end())
-        return it->second;
+        id = it->second;
+    else if (to_base(d) && !_config.base_od)
+        // In a base spec from another run, whose ids differ; it is
+        // referred to by USR
+        id = _decl_map[d] = 0;
+    else if (_config.incremental)
+        id = _decl_map[d] = key_id(id_key(d));
     else
+        id = _decl_map[d] = ++_decl_id;
+
+    if (_ids_used && id) _ids_used->insert(id);
+    return id;
+}
+
+unsigned int C2FFIASTConsumer::decl_id(const clang::Decl *d) const {
+    auto it = _decl_map.find(d);
+
+    if (it == _decl_map.end())
         return 0;
+
+    if (_ids_used && it->second) _ids_used->insert(it->second);
+    return it->second;
+}
+
+// What d is and where, which is the same in the next run as long as
+// its file is
+std::string C2FFIASTConsumer::id_key(const clang::Decl *d) const {
+    const clang::SourceManager &sm = _ci.getSourceManager();
+    clang::SourceLocation loc = d->getLocation();
+    llvm::SmallString<128> buf;
+
+    // True means there is none
+    if (clang::index::generateUSRForDecl(d, buf))
+        buf.clear();
+
+    std::string key = std::string(d->getDeclKindName()) + " " + buf.str().str();
+
+    if (loc.isValid())
+        key += "@" + file_path(sm, loc) + ":"
+               + std::to_string(sm.getFileOffset(sm.getExpansionLoc(loc)));
+
+    return key;
+}
+
+unsigned int C2FFIASTConsumer::key_id(const std::string &key) {
+    unsigned int &id = _key_ids[key];
+
+    if (!id) {
+        id = ++_decl_id;
+        _id_keys[id] = key;
+    }
+
+    return id;
+}
+
+const std::string &C2FFIASTConsumer::key_of(unsigned int id) const {
+    static const std::string none;
+    auto it = _id_keys.find(id);
+
+    return it != _id_keys.end() ? it->second : none;
+}
+
+std::string C2FFIASTConsumer::usr(const clang::Decl *d) const {
+    llvm::SmallString<128> buf;
+
+    if (_config.usr == usr_none || !d)
+        return "";
+
+    // True means there is none, e.g. for function-local declarations
+    if (clang::index::generateUSRForDecl(d, buf))
+        return "";
+
+    if (_config.usr == usr_hash)
+        return llvm::utohexstr(llvm::xxHash64(buf), true);
+
+    return std::string(buf.begin(), buf.end());
 }
 
 
@@ -450,7 +831,7 @@ Decl *C2FFIASTConsumer::make_decl(const clang::VarTemplateDecl *d) {
     clang::APValue *v = nullptr;
     std::string name = d->getDeclName().getAsString();
     std::string value;
-    std::string loc;
+    clang::SourceLocation loc;
     bool is_string = false;
 
     if (name.substr(0, 8) == "__c2ffi_") {
@@ -461,7 +842,7 @@ Decl *C2FFIASTConsumer::make_decl(const clang::VarTemplateDecl *d) {
         const clang::MacroInfo *mi = pp.getMacroInfo(&ii);
 
         if (mi)
-            loc = mi->getDefinitionLoc().printToString(_ci.getSourceManager());
+            loc = mi->getDefinitionLoc();
     }
 
     clang::VarDecl *var_decl = d->getTemplatedDecl();
@@ -499,8 +880,7 @@ Decl *C2FFIASTConsumer::make_decl(const clang::VarTemplateDecl *d) {
                                    var_decl->hasExternalStorage(), is_string,
                                    d->getTemplateParameters());
 
-    if (!loc.empty())
-        cv->set_location(loc);
+    cv->set_location(_ci, loc);
 
     return cv;
 }
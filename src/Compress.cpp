@@ -0,0 +1,244 @@
+/*
+    c2ffi
+    Copyright (C) 2013  Ryan Pavlik
+
+    This file is part of c2ffi.
+
+    c2ffi is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    c2ffi is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <vector>
+
+#ifdef C2FFI_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef C2FFI_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "c2ffi/compress.h"
+
+using namespace c2ffi;
+
+namespace c2ffi {
+    /* Collects output and hands it to compress() a buffer at a time */
+    class CompressBuf : public std::streambuf {
+        std::vector<char> _in;
+        bool _ok;
+
+        bool drain(int how) {
+            size_t n = pptr() - pbase();
+            setp(_in.data(), _in.data() + _in.size());
+
+            return _ok && compress(_in.data(), n, how);
+        }
+
+    protected:
+        enum { run, flush, end };
+
+        std::ostream *_os;
+        std::vector<char> _out;
+
+        // Compresses n bytes into _out and on to _os; on flush or end,
+        // also whatever the compressor was holding back
+        virtual bool compress(const char *data, size_t n, int how) = 0;
+
+        bool fail(const char *what) {
+            if (_ok)
+                std::cerr << "Error: compressing output: " << what << std::endl;
+
+            _ok = false;
+            return false;
+        }
+
+        int overflow(int c) override {
+            if (!drain(run))
+                return traits_type::eof();
+
+            if (c != traits_type::eof()) {
+                *pptr() = (char) c;
+                pbump(1);
+            }
+
+            return traits_type::not_eof(c);
+        }
+
+        int sync() override {
+            if (!drain(flush))
+                return -1;
+
+            _os->flush();
+            return 0;
+        }
+
+    public:
+        explicit CompressBuf(std::ostream *os)
+                : _in(1 << 16), _ok(true), _os(os), _out(1 << 16) {
+            setp(_in.data(), _in.data() + _in.size());
+        }
+
+        ~CompressBuf() override {}
+
+        bool finish() {
+            bool ok = drain(end);
+
+            _os->flush();
+
+            if (ok && !_os->good())
+                return fail("write failed");
+
+            return ok;
+        }
+    };
+
+#ifdef C2FFI_HAVE_ZLIB
+    // deflate, with a gzip or zlib wrapper
+    class ZlibBuf : public CompressBuf {
+        z_stream _z;
+
+        bool compress(const char *data, size_t n, int how) override {
+            int mode = how == end ? Z_FINISH :
+                       how == flush ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+
+            _z.next_in = (Bytef *) data;
+            _z.avail_in = (uInt) n;
+
+            do {
+                _z.next_out = (Bytef *) _out.data();
+                _z.avail_out = (uInt) _out.size();
+
+                if (deflate(&_z, mode) == Z_STREAM_ERROR)
+                    return fail(_z.msg ? _z.msg : "deflate failed");
+
+                _os->write(_out.data(), _out.size() - _z.avail_out);
+            } while (_z.avail_out == 0);
+
+            return true;
+        }
+
+    public:
+        ZlibBuf(std::ostream *os, bool gzip) : CompressBuf(os), _z() {
+            if (deflateInit2(&_z, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                             gzip ? 15 + 16 : 15, 8,
+                             Z_DEFAULT_STRATEGY) != Z_OK)
+                fail("cannot initialize zlib");
+        }
+
+        ~ZlibBuf() override { deflateEnd(&_z); }
+    };
+#endif
+
+#ifdef C2FFI_HAVE_ZSTD
+    class ZstdBuf : public CompressBuf {
+        ZSTD_CStream *_z;
+
+        bool compress(const char *data, size_t n, int how) override {
+            ZSTD_inBuffer in = {data, n, 0};
+
+            while (in.pos < in.size) {
+                ZSTD_outBuffer out = {_out.data(), _out.size(), 0};
+                size_t r = ZSTD_compressStream(_z, &out, &in);
+
+                if (ZSTD_isError(r))
+                    return fail(ZSTD_getErrorName(r));
+
+                _os->write(_out.data(), out.pos);
+            }
+
+            if (how == run)
+                return true;
+
+            // Until nothing is left to write
+            for (;;) {
+                ZSTD_outBuffer out = {_out.data(), _out.size(), 0};
+                size_t r = how == end ? ZSTD_endStream(_z, &out)
+                                      : ZSTD_flushStream(_z, &out);
+
+                if (ZSTD_isError(r))
+                    return fail(ZSTD_getErrorName(r));
+
+                _os->write(_out.data(), out.pos);
+
+                if (!r)
+                    return true;
+            }
+        }
+
+    public:
+        explicit ZstdBuf(std::ostream *os)
+                : CompressBuf(os), _z(ZSTD_createCStream()) {
+            _out.resize(ZSTD_CStreamOutSize());
+
+            if (!_z)
+                fail("cannot initialize zstd");
+            else if (ZSTD_isError(ZSTD_initCStream(_z, 3)))
+                fail("cannot initialize zstd");
+        }
+
+        ~ZstdBuf() override { ZSTD_freeCStream(_z); }
+    };
+#endif
+}
+
+bool c2ffi::parse_compress_mode(const std::string &name, compress_mode &mode) {
+    if (name == "none") mode = compress_none;
+    else if (name == "gzip") mode = compress_gzip;
+    else if (name == "zlib") mode = compress_zlib;
+    else if (name == "zstd") mode = compress_zstd;
+    else return false;
+
+    return true;
+}
+
+static bool ends_with(const std::string &s, const char *suffix) {
+    size_t n = std::char_traits<char>::length(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+compress_mode c2ffi::compress_mode_for(const std::string &path) {
+    if (ends_with(path, ".gz")) return compress_gzip;
+    if (ends_with(path, ".zst")) return compress_zstd;
+
+    return compress_none;
+}
+
+CompressStream::CompressStream(CompressBuf *buf)
+        : std::ostream(buf), _buf(buf) {}
+
+CompressStream::~CompressStream() {
+    delete _buf;
+}
+
+CompressStream *CompressStream::make(std::ostream *os, compress_mode mode) {
+    switch (mode) {
+#ifdef C2FFI_HAVE_ZLIB
+        case compress_gzip:
+            return new CompressStream(new ZlibBuf(os, true));
+        case compress_zlib:
+            return new CompressStream(new ZlibBuf(os, false));
+#endif
+#ifdef C2FFI_HAVE_ZSTD
+        case compress_zstd:
+            return new CompressStream(new ZstdBuf(os));
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+bool CompressStream::finish() {
+    return _buf->finish();
+}
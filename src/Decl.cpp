@@ -22,6 +22,9 @@
 #include <clang/AST/DeclCXX.h>
 #include <clang/AST/ASTContext.h>
 
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <utility>
 
 #include "c2ffi.h"
@@ -33,13 +36,46 @@ Decl::Decl(clang::NamedDecl *d) {
     _name = d->getDeclName().getAsString();
 }
 
-void Decl::set_location(clang::CompilerInstance &ci, const clang::Decl *d) {
-    clang::SourceLocation source_location = d->getLocation();
+// Looked up by the name clang hands back, which is the same pointer
+// for every location in a file, and only then by its text
+static const SourceFile *intern_file(const char *name) {
+    static std::unordered_map<const char *, const SourceFile *> by_pointer;
+    static std::unordered_map<std::string, std::unique_ptr<SourceFile>> by_path;
 
-    if (source_location.isValid()) {
-        std::string loc = source_location.printToString(ci.getSourceManager());
-        set_location(loc);
-    }
+    auto i = by_pointer.find(name);
+    if (i != by_pointer.end())
+        return i->second;
+
+    std::unique_ptr<SourceFile> &f = by_path[name];
+
+    if (!f)
+        f.reset(new SourceFile{name, (unsigned int) by_path.size()});
+
+    return by_pointer[name] = f.get();
+}
+
+void Decl::set_location(clang::CompilerInstance &ci, clang::SourceLocation loc) {
+    if (loc.isInvalid()) return;
+
+    clang::SourceManager &sm = ci.getSourceManager();
+    clang::PresumedLoc ploc = sm.getPresumedLoc(loc);
+
+    // The numbers alone would lose what clang says here, so keep its text
+    if (loc.isMacroID() || ploc.isInvalid())
+        _spelled = loc.printToString(sm);
+
+    if (ploc.isInvalid()) return;
+
+    _file = intern_file(ploc.getFilename());
+    _line = ploc.getLine();
+    _column = ploc.getColumn();
+}
+
+std::string Decl::location() const {
+    if (!_spelled.empty()) return _spelled;
+    if (!_file) return std::string();
+
+    return _file->path + ":" + std::to_string(_line) + ":" + std::to_string(_column);
 }
 
 FieldsMixin::~FieldsMixin() {
@@ -95,6 +131,7 @@ void FunctionsMixin::add_functions(C2FFIASTConsumer *ast, const clang::ObjCConta
         f->set_is_objc_method(true);
         f->set_is_class_method(m->isClassMethod());
         f->set_location(ast->ci(), (*m));
+        f->set_usr(ast->usr(*m));
 
         for (clang::FunctionDecl::param_const_iterator i = m->param_begin();
              i != m->param_end(); i++) {
@@ -123,6 +160,7 @@ void FunctionsMixin::add_functions(C2FFIASTConsumer *ast, const clang::CXXRecord
         f->set_is_const(m->isConst());
         f->set_is_pure(m->isPure());
         f->set_location(ast->ci(), m);
+        f->set_usr(ast->usr(m));
 
         for (clang::FunctionDecl::param_const_iterator param_iter = m->param_begin();
              param_iter != m->param_end(); param_iter++) {
@@ -0,0 +1,260 @@
+/*
+    c2ffi
+    Copyright (C) 2013  Ryan Pavlik
+
+    This file is part of c2ffi.
+
+    c2ffi is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    c2ffi is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <llvm/Support/JSON.h>
+
+#include <clang/AST/DeclCXX.h>
+#include <clang/AST/DeclObjC.h>
+#include <clang/AST/DeclTemplate.h>
+
+#include "c2ffi.h"
+#include "c2ffi/ast.h"
+#include "c2ffi/deps.h"
+
+using namespace c2ffi;
+
+void c2ffi::type_deps(const clang::Type *t, ClangDeclVector &out) {
+    /*** Order is important here, see Type::make_type ***/
+    while (t) {
+        if (t->isVoidType() || t->isBuiltinType())
+            return;
+
+        if_const_cast(td, clang::TypedefType, t) {
+            out.push_back(td->getDecl());
+            return;
+        }
+
+        if_const_cast(tt, clang::SubstTemplateTypeParmType, t) {
+            if (tt != tt->desugar().getTypePtr()) {
+                t = tt->desugar().getTypePtr();
+                continue;
+            }
+        }
+
+        if_const_cast(e, clang::ElaboratedType, t) {
+            t = e->getNamedType().getTypePtr();
+            continue;
+        }
+
+        if (t->isFunctionPointerType() || t->isFunctionType())
+            return;
+
+        if (t->isPointerType() || t->isReferenceType()) {
+            t = t->getPointeeType().getTypePtr();
+            continue;
+        }
+
+        if_const_cast(rt, clang::RecordType, t) {
+            out.push_back(rt->getDecl());
+            return;
+        }
+
+        if_const_cast(tt, clang::TemplateSpecializationType, t) {
+            if (tt != tt->desugar().getTypePtr()) {
+                t = tt->desugar().getTypePtr();
+                continue;
+            }
+        }
+
+        if_const_cast(et, clang::EnumType, t) {
+            out.push_back(et->getDecl());
+            return;
+        }
+
+        if_const_cast(at, clang::ArrayType, t) {
+            t = at->getElementType().getTypePtr();
+            continue;
+        }
+
+        if_const_cast(op, clang::ObjCObjectPointerType, t) {
+            t = op->getPointeeType().getTypePtr();
+            continue;
+        }
+
+        if_const_cast(ob, clang::ObjCObjectType, t) {
+            if (ob->getInterface())
+                out.push_back(ob->getInterface());
+        }
+
+        return;
+    }
+}
+
+static void args_deps(const clang::TemplateArgumentList &args, ClangDeclVector &out) {
+    for (size_t i = 0; i < args.size(); i++) {
+        const clang::TemplateArgument &arg = args[i];
+
+        if (arg.getKind() == clang::TemplateArgument::Type)
+            type_deps(arg.getAsType().getTypePtrOrNull(), out);
+        else if (arg.getKind() == clang::TemplateArgument::Integral)
+            type_deps(arg.getIntegralType().getTypePtrOrNull(), out);
+        else if (arg.getKind() == clang::TemplateArgument::Declaration)
+            type_deps(arg.getAsDecl()->getType().getTypePtrOrNull(), out);
+    }
+}
+
+static void methods_deps(const clang::ObjCContainerDecl *d, ClangDeclVector &out) {
+    for (const clang::ObjCMethodDecl *m : d->methods()) {
+        type_deps(m->getReturnType().getTypePtr(), out);
+
+        for (const clang::ParmVarDecl *p : m->parameters())
+            type_deps(p->getOriginalType().getTypePtr(), out);
+    }
+}
+
+void c2ffi::decl_deps(const clang::Decl *d, ClangDeclVector &out) {
+    if_const_cast(fd, clang::FunctionDecl, d) {
+        type_deps(fd->getReturnType().getTypePtr(), out);
+
+        for (const clang::ParmVarDecl *p : fd->parameters())
+            type_deps(p->getOriginalType().getTypePtr(), out);
+
+        if (const clang::TemplateArgumentList *args = fd->getTemplateSpecializationArgs())
+            args_deps(*args, out);
+    } else if_const_cast(vtd, clang::VarTemplateDecl, d) {
+        type_deps(vtd->getTemplatedDecl()->getType().getTypePtr(), out);
+    } else if_const_cast(vd, clang::VarDecl, d) {
+        type_deps(vd->getType().getTypePtr(), out);
+    } else if_const_cast(tat, clang::TypeAliasTemplateDecl, d) {
+        type_deps(tat->getTemplatedDecl()->getUnderlyingType().getTypePtr(), out);
+    } else if_const_cast(tnd, clang::TypedefNameDecl, d) {
+        type_deps(tnd->getUnderlyingType().getTypePtr(), out);
+    } else if_const_cast(rd, clang::RecordDecl, d) {
+        for (const clang::FieldDecl *f : rd->fields())
+            type_deps(f->getType().getTypePtr(), out);
+
+        if_const_cast(cxx, clang::CXXRecordDecl, d) {
+            if (cxx->hasDefinition()) {
+                for (const clang::CXXBaseSpecifier &base : cxx->bases())
+                    type_deps(base.getType().getTypePtr(), out);
+
+                for (const clang::CXXMethodDecl *m : cxx->methods())
+                    decl_deps(m, out);
+            }
+
+            if_const_cast(cts, clang::ClassTemplateSpecializationDecl, d)
+                args_deps(cts->getTemplateArgs(), out);
+        }
+    } else if_const_cast(oi, clang::ObjCInterfaceDecl, d) {
+        if (oi->hasDefinition()) {
+            if (oi->getSuperClass())
+                out.push_back(oi->getSuperClass());
+
+            for (const clang::ObjCIvarDecl *ivar : oi->ivars())
+                type_deps(ivar->getType().getTypePtr(), out);
+        }
+
+        methods_deps(oi, out);
+    } else if_const_cast(oc, clang::ObjCContainerDecl, d) {
+        if_const_cast(cat, clang::ObjCCategoryDecl, d) {
+            if (cat->getClassInterface())
+                out.push_back(cat->getClassInterface());
+        }
+
+        methods_deps(oc, out);
+    }
+}
+
+const clang::Decl *c2ffi::decl_definition(const clang::Decl *d) {
+    if_const_cast(td, clang::TagDecl, d) {
+        if (const clang::TagDecl *def = td->getDefinition())
+            return def;
+    } else if_const_cast(oi, clang::ObjCInterfaceDecl, d) {
+        if (const clang::ObjCInterfaceDecl *def = oi->getDefinition())
+            return def;
+    }
+
+    return d;
+}
+
+std::string c2ffi::decl_kind_name(const clang::Decl *d) {
+    if_const_cast(td, clang::TagDecl, d)
+        return td->getKindName();
+
+    if (llvm::isa<clang::TypedefNameDecl>(d)) return "typedef";
+    if (llvm::isa<clang::FunctionDecl>(d)) return "function";
+    if (llvm::isa<clang::VarDecl>(d)) return "var";
+    if (llvm::isa<clang::NamespaceDecl>(d)) return "namespace";
+    if (llvm::isa<clang::ObjCInterfaceDecl>(d)) return "@interface";
+    if (llvm::isa<clang::ObjCCategoryDecl>(d)) return "@category";
+    if (llvm::isa<clang::ObjCProtocolDecl>(d)) return "@protocol";
+
+    return d->getDeclKindName();
+}
+
+static std::string deps_name(const clang::Decl *d) {
+    const auto *nd = llvm::dyn_cast<clang::NamedDecl>(d);
+    if (!nd) return std::string();
+
+    std::string name = nd->getQualifiedNameAsString();
+
+    // Macro constants
+    if (name.compare(0, 8, "__c2ffi_") == 0)
+        name.erase(0, 8);
+
+    return name;
+}
+
+static void write_deps_entry(llvm::raw_ostream &out, clang::SourceManager &sm,
+                             const clang::Decl *d) {
+    clang::PresumedLoc ploc = sm.getPresumedLoc(d->getLocation());
+
+    out << "{ \"name\": " << llvm::json::Value(deps_name(d))
+        << ", \"kind\": " << llvm::json::Value(decl_kind_name(d))
+        << ", \"file\": "
+        << llvm::json::Value(ploc.isValid() ? ploc.getFilename() : "");
+}
+
+void c2ffi::write_decl_deps(llvm::raw_ostream &out, clang::SourceManager &sm,
+                            const clang::Decl *d) {
+    ClangDeclVector deps;
+    ClangDeclSet seen;
+    bool mid = false;
+
+    decl_deps(decl_definition(d), deps);
+    seen.insert(d->getCanonicalDecl());
+
+    write_deps_entry(out, sm, d);
+    out << ", \"deps\": [";
+
+    // deps grows as anonymous records are looked into
+    for (size_t i = 0; i < deps.size(); i++) {
+        const clang::Decl *dep = deps[i]->getCanonicalDecl();
+
+        if (!seen.insert(dep).second)
+            continue;
+
+        // Written inline, so what they refer to is referred to here
+        if_const_cast(td, clang::TagDecl, dep) {
+            if (td->getName().empty()) {
+                decl_deps(decl_definition(dep), deps);
+                continue;
+            }
+        }
+
+        if (mid) out << ", ";
+        mid = true;
+
+        write_deps_entry(out, sm, decl_definition(dep));
+        out << " }";
+    }
+
+    out << "] }\n";
+}
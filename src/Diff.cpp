@@ -0,0 +1,466 @@
+/*
+    c2ffi
+    Copyright (C) 2013  Ryan Pavlik
+
+    This file is part of c2ffi.
+
+    c2ffi is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    c2ffi is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <llvm/Support/Error.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include "c2ffi/spec.h"
+
+using namespace c2ffi;
+
+namespace {
+    struct SpecEntry {
+        std::string text;
+        std::string tag;
+        bool anonymous;
+        bool matched;
+    };
+
+    typedef std::map<std::string, SpecEntry> SpecEntryMap;
+
+    // One side of the diff
+    struct Spec {
+        SpecEntryMap entries;
+        std::vector<std::string> order;
+
+        // The path in its "base" marker, if it has one
+        std::string base;
+        bool has_base = false;
+
+        // --type-table and --file-table entries, by id
+        std::map<int64_t, llvm::json::Value> types;
+        std::map<int64_t, std::string> sources;
+    };
+
+    struct DiffState {
+        llvm::raw_ostream &out;
+        bool mid;
+        bool changed;
+        bool breaking;
+
+        explicit DiffState(llvm::raw_ostream &os)
+                : out(os), mid(false), changed(false), breaking(false) {}
+
+        void begin(const char *tag) {
+            out << (mid ? ",\n" : "") << "{ \"tag\": \"" << tag << "\"";
+            mid = true;
+            changed = true;
+        }
+    };
+}
+
+static bool parse_object(const std::string &text, llvm::json::Object &o) {
+    llvm::Expected<llvm::json::Value> v = llvm::json::parse(text);
+
+    if (!v) {
+        llvm::consumeError(v.takeError());
+        return false;
+    }
+
+    if (!v->getAsObject())
+        return false;
+
+    o = std::move(*v->getAsObject());
+    return true;
+}
+
+// Locations and ids move whenever anything above them changes, so they
+// are not part of what is compared
+static void strip_positions(llvm::json::Value &v) {
+    if (llvm::json::Object *o = v.getAsObject()) {
+        o->erase("location");
+        o->erase("id");
+        o->erase("ns");
+
+        for (auto &kv : *o)
+            strip_positions(kv.second);
+    } else if (llvm::json::Array *a = v.getAsArray()) {
+        for (auto &e : *a)
+            strip_positions(e);
+    }
+}
+
+static std::string to_text(const llvm::json::Value &v) {
+    std::string s;
+    llvm::raw_string_ostream os(s);
+
+    os << v;
+    return os.str();
+}
+
+/* Puts back what --type-table and --file-table took out: type numbers
+   become the type, and file numbers, lines and columns a location.
+   False if a number isn't in the table. */
+static bool resolve(Spec &spec, llvm::json::Value &v) {
+    if (llvm::json::Object *o = v.getAsObject()) {
+        for (auto &kv : *o) {
+            llvm::StringRef k = kv.first;
+
+            if (k == "type" || k == "return-type") {
+                if (llvm::Optional<int64_t> id = kv.second.getAsInteger()) {
+                    auto it = spec.types.find(*id);
+                    if (it == spec.types.end()) return false;
+
+                    kv.second = it->second;
+                    continue;
+                }
+            }
+
+            if (!resolve(spec, kv.second)) return false;
+        }
+
+        llvm::Optional<int64_t> file = o->getInteger("file");
+
+        if (file && !spec.sources.empty()) {
+            auto it = spec.sources.find(*file);
+            if (it == spec.sources.end()) return false;
+
+            llvm::Optional<int64_t> line = o->getInteger("line");
+            llvm::Optional<int64_t> column = o->getInteger("column");
+
+            (*o)["location"] = it->second + ":" + std::to_string(line ? *line : 0)
+                               + ":" + std::to_string(column ? *column : 0);
+            o->erase("file");
+            o->erase("line");
+            o->erase("column");
+        }
+    } else if (llvm::json::Array *a = v.getAsArray()) {
+        for (auto &e : *a)
+            if (!resolve(spec, e)) return false;
+    }
+
+    return true;
+}
+
+/* tag, name and the occurrence of that pair.  Anonymous declarations
+   go by what they contain instead, less positions, so they still match
+   when something above them moves; see spec_diff() for those which
+   changed. */
+static std::string entry_key(llvm::StringRef tag, const llvm::json::Value &v,
+                             bool &anonymous,
+                             std::map<std::string, unsigned> &seen) {
+    llvm::Optional<llvm::StringRef> name = v.getAsObject()->getString("name");
+    std::string key = tag.str();
+
+    anonymous = !name || name->empty();
+
+    if (!anonymous) {
+        key += "\n" + name->str();
+    } else {
+        llvm::json::Value content = v;
+
+        strip_positions(content);
+        key += "\n#" + to_text(content);
+    }
+
+    key += "\n" + std::to_string(seen[key]++);
+    return key;
+}
+
+static bool read_spec(const char *path, Spec &spec) {
+    SpecReader in(path);
+    std::map<std::string, unsigned> seen;
+    std::string text;
+
+    if (!in.is_open()) {
+        std::cerr << "Error: cannot read " << path << std::endl;
+        return false;
+    }
+
+    while (in.next(text)) {
+        std::string tag = spec_tag(text).str();
+
+        // File markers from --incremental are not declarations, and
+        // forward declarations only order the output; the declaration
+        // itself is compared
+        if (tag == "file" || tag == "forward") continue;
+
+        llvm::Expected<llvm::json::Value> v = llvm::json::parse(text);
+
+        if (!v || !v->getAsObject()) {
+            if (!v) llvm::consumeError(v.takeError());
+
+            std::cerr << "Error: " << path << " is not json driver output"
+                      << std::endl;
+            return false;
+        }
+
+        llvm::json::Object &o = *v->getAsObject();
+
+        if (tag == "base") {
+            llvm::Optional<llvm::StringRef> base = o.getString("path");
+
+            spec.base = base ? base->str() : std::string();
+            spec.has_base = true;
+            continue;
+        }
+
+        if (!spec.types.empty() || !spec.sources.empty()) {
+            if (!resolve(spec, *v)) {
+                std::cerr << "Error: " << path << " refers to a type or "
+                          << "file before it is in the table" << std::endl;
+                return false;
+            }
+
+            text = to_text(*v);
+        }
+
+        llvm::Optional<int64_t> id = o.getInteger("id");
+
+        if (tag == "type" && id && o.get("type")) {
+            spec.types.erase(*id);
+            spec.types.emplace(*id, *o.get("type"));
+            continue;
+        }
+
+        if (tag == "source" && id) {
+            llvm::Optional<llvm::StringRef> file = o.getString("path");
+
+            spec.sources[*id] = file ? file->str() : std::string();
+            continue;
+        }
+
+        SpecEntry e = {text, tag, false, false};
+        std::string key = entry_key(tag, *v, e.anonymous, seen);
+
+        spec.order.push_back(key);
+        spec.entries[key] = std::move(e);
+    }
+
+    return true;
+}
+
+static void diff_layout_value(llvm::raw_ostream &layout, bool &mid,
+                              const char *field, const char *what,
+                              const llvm::json::Object &a,
+                              const llvm::json::Object &b) {
+    llvm::Optional<int64_t> x = a.getInteger(what);
+    llvm::Optional<int64_t> y = b.getInteger(what);
+
+    if (x == y) return;
+
+    layout << (mid ? ", " : "") << "{ ";
+    if (field)
+        layout << "\"field\": " << llvm::json::Value(field) << ", ";
+    layout << "\"change\": \"" << what << "\", \"old\": " << (x ? *x : 0)
+           << ", \"new\": " << (y ? *y : 0) << " }";
+
+    mid = true;
+}
+
+// Field-level layout changes of a record; true if there were any
+static bool diff_layout(llvm::raw_ostream &layout,
+                        const llvm::json::Object &a,
+                        const llvm::json::Object &b) {
+    bool mid = false;
+
+    diff_layout_value(layout, mid, nullptr, "bit-size", a, b);
+    diff_layout_value(layout, mid, nullptr, "bit-alignment", a, b);
+
+    const llvm::json::Array *af = a.getArray("fields");
+    const llvm::json::Array *bf = b.getArray("fields");
+    std::map<std::string, const llvm::json::Object *> fields;
+
+    if (bf) {
+        for (auto &f : *bf) {
+            if (const llvm::json::Object *o = f.getAsObject())
+                if (llvm::Optional<llvm::StringRef> name = o->getString("name"))
+                    fields[name->str()] = o;
+        }
+    }
+
+    if (af) {
+        for (auto &f : *af) {
+            const llvm::json::Object *x = f.getAsObject();
+            llvm::Optional<llvm::StringRef> name = x ? x->getString("name") : llvm::None;
+
+            if (!name) continue;
+
+            std::string n = name->str();
+            auto it = fields.find(n);
+
+            if (it == fields.end()) {
+                layout << (mid ? ", " : "") << "{ \"field\": "
+                       << llvm::json::Value(n) << ", \"change\": \"removed\" }";
+                mid = true;
+                continue;
+            }
+
+            const llvm::json::Object *y = it->second;
+            fields.erase(it);
+
+            diff_layout_value(layout, mid, n.c_str(), "bit-offset", *x, *y);
+            diff_layout_value(layout, mid, n.c_str(), "bit-size", *x, *y);
+            diff_layout_value(layout, mid, n.c_str(), "bit-alignment", *x, *y);
+
+            const llvm::json::Value *xt = x->get("type");
+            const llvm::json::Value *yt = y->get("type");
+
+            if (xt && yt) {
+                llvm::json::Value xs = *xt, ys = *yt;
+                strip_positions(xs);
+                strip_positions(ys);
+
+                if (xs != ys) {
+                    layout << (mid ? ", " : "") << "{ \"field\": "
+                           << llvm::json::Value(n) << ", \"change\": \"type\", \"old\": "
+                           << *xt << ", \"new\": " << *yt << " }";
+                    mid = true;
+                }
+            }
+        }
+    }
+
+    for (auto &kv : fields) {
+        layout << (mid ? ", " : "") << "{ \"field\": "
+               << llvm::json::Value(kv.first) << ", \"change\": \"added\" }";
+        mid = true;
+    }
+
+    return mid;
+}
+
+// tag is b's, as read_spec() found it; the text may have been written
+// again since, without the tag first
+static void diff_entry(DiffState &st, const std::string &tag,
+                       const std::string &a, const std::string &b) {
+    if (a == b) return;
+
+    llvm::json::Object x, y;
+
+    if (parse_object(a, x) && parse_object(b, y)) {
+        llvm::json::Value xv(std::move(x)), yv(std::move(y));
+        strip_positions(xv);
+        strip_positions(yv);
+
+        if (xv == yv) return;
+
+        if (tag == "struct" || tag == "union" || tag == "class") {
+            std::string s;
+            llvm::raw_string_ostream layout(s);
+
+            if (diff_layout(layout, *xv.getAsObject(), *yv.getAsObject())) {
+                layout.flush();
+                st.begin("changed");
+                st.out << ", \"decl\": " << b << ", \"layout\": [" << s << "] }";
+                st.breaking = true;
+                return;
+            }
+        }
+    }
+
+    st.begin("changed");
+    st.out << ", \"decl\": " << b << " }";
+}
+
+/* c2ffi diff OLD NEW
+ *
+ * Compares two outputs of the json driver and writes the declarations
+ * which were added, removed or changed, as json.  Records whose layout
+ * changed list each field-level change.  Anonymous declarations which
+ * are not found unchanged are paired up in order, by tag.  Output using
+ * a base spec is compared without it; diff the base specs on their own.
+ * Exits with 0 if nothing changed, 1 if something did, 2 if a
+ * declaration was removed or a layout changed, and 3 on errors.
+ */
+int c2ffi::spec_diff(int argc, char *argv[]) {
+    Spec old_spec, new_spec;
+
+    if (argc != 3) {
+        std::cerr << "Usage: c2ffi diff OLD NEW" << std::endl;
+        return 3;
+    }
+
+    if (!read_spec(argv[1], old_spec) || !read_spec(argv[2], new_spec))
+        return 3;
+
+    // Otherwise whatever moved into or out of the base would look
+    // removed or added
+    if (old_spec.has_base != new_spec.has_base) {
+        std::cerr << "Error: only " << argv[old_spec.has_base ? 1 : 2]
+                  << " uses a base spec" << std::endl;
+        return 3;
+    }
+
+    SpecEntryMap &old_entries = old_spec.entries;
+    SpecEntryMap &new_entries = new_spec.entries;
+
+    // Anonymous declarations with no unchanged match, by tag
+    std::map<std::string, std::vector<SpecEntry *>> old_anonymous;
+    std::map<std::string, size_t> next_anonymous;
+
+    for (auto &key : old_spec.order) {
+        SpecEntry &e = old_entries[key];
+
+        if (e.anonymous && !new_entries.count(key))
+            old_anonymous[e.tag].push_back(&e);
+    }
+
+    DiffState st(llvm::outs());
+    st.out << "[\n";
+
+    if (old_spec.base != new_spec.base) {
+        st.begin("changed");
+        st.out << ", \"base\": " << llvm::json::Value(new_spec.base) << " }";
+    }
+
+    for (auto &key : new_spec.order) {
+        const SpecEntry &e = new_entries[key];
+        auto it = old_entries.find(key);
+        SpecEntry *old = it != old_entries.end() ? &it->second : nullptr;
+
+        if (!old && e.anonymous) {
+            std::vector<SpecEntry *> &v = old_anonymous[e.tag];
+            size_t &next = next_anonymous[e.tag];
+
+            if (next < v.size()) old = v[next++];
+        }
+
+        if (!old) {
+            st.begin("added");
+            st.out << ", \"decl\": " << e.text << " }";
+            continue;
+        }
+
+        old->matched = true;
+        diff_entry(st, e.tag, old->text, e.text);
+    }
+
+    for (auto &key : old_spec.order) {
+        const SpecEntry &e = old_entries[key];
+
+        if (e.matched) continue;
+
+        st.begin("removed");
+        st.out << ", \"decl\": " << e.text << " }";
+        st.breaking = true;
+    }
+
+    st.out << "\n]\n";
+    st.out.flush();
+
+    return st.breaking ? 2 : (st.changed ? 1 : 0);
+}
@@ -0,0 +1,131 @@
+/*
+    c2ffi
+    Copyright (C) 2013  Ryan Pavlik
+
+    This file is part of c2ffi.
+
+    c2ffi is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    c2ffi is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "c2ffi/escape.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define C2FFI_HAVE_SSE2 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if C2FFI_HAVE_SSE2 && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define C2FFI_HAVE_AVX2 1
+#endif
+
+using namespace c2ffi;
+
+static inline bool needs_escape(unsigned char c) {
+    return c < 32 || c > 127 || c == '"' || c == '\\';
+}
+
+static size_t scan_scalar(const char *s, size_t i, size_t n) {
+    for (; i < n; i++)
+        if (needs_escape((unsigned char) s[i])) return i;
+
+    return n;
+}
+
+#if C2FFI_HAVE_SSE2
+static inline int trailing_zeros(unsigned int mask) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(mask);
+#else
+    unsigned long i;
+    _BitScanForward(&i, mask);
+    return (int) i;
+#endif
+}
+
+/* As signed bytes, both control characters and everything above 127 are
+   below 32, so one comparison catches them. */
+static size_t scan_sse2(const char *s, size_t n) {
+    const __m128i space = _mm_set1_epi8(32);
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    size_t i = 0;
+
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+        __m128i m = _mm_or_si128(_mm_cmplt_epi8(v, space),
+                                 _mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                              _mm_cmpeq_epi8(v, backslash)));
+        auto mask = (unsigned int) _mm_movemask_epi8(m);
+
+        if (mask) return i + trailing_zeros(mask);
+    }
+
+    return scan_scalar(s, i, n);
+}
+#endif
+
+#if C2FFI_HAVE_AVX2
+__attribute__((target("avx2")))
+static size_t scan_avx2(const char *s, size_t n) {
+    // Most names are shorter than one block; leave the ymm registers alone
+    if (n < 32) return scan_sse2(s, n);
+
+    const __m256i space = _mm256_set1_epi8(32);
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    size_t i = 0;
+
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (s + i));
+        __m256i m = _mm256_or_si256(_mm256_cmpgt_epi8(space, v),
+                                    _mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                                                    _mm256_cmpeq_epi8(v, backslash)));
+        auto mask = (unsigned int) _mm256_movemask_epi8(m);
+
+        if (mask) return i + __builtin_ctz(mask);
+    }
+
+    // The tail is short; SSE2 finishes it, once the upper halves are
+    // cleared so the non-VEX code doesn't pay for a state transition
+    _mm256_zeroupper();
+    return i + scan_sse2(s + i, n - i);
+}
+#endif
+
+typedef size_t (*ScanFn)(const char *, size_t);
+
+static ScanFn select_scan() {
+#if C2FFI_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2")) return scan_avx2;
+#endif
+#if C2FFI_HAVE_SSE2
+    return scan_sse2;
+#else
+    return [](const char *s, size_t n) { return scan_scalar(s, 0, n); };
+#endif
+}
+
+size_t c2ffi::json_escape_scan(const char *s, size_t n) {
+    static const ScanFn scan = select_scan();
+
+    return scan(s, n);
+}
+
+size_t c2ffi::json_escape_scan_scalar(const char *s, size_t n) {
+    return scan_scalar(s, 0, n);
+}
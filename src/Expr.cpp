@@ -196,9 +196,12 @@ void c2ffi::process_macros(clang::CompilerInstance &ci, std::ostream &os,
          i != pp.macro_end(); i++) {
         const clang::MacroInfo *mi = i->getSecond().getLatest()->getMacroInfo();
         const clang::SourceLocation sl = mi->getDefinitionLoc();
-        std::string loc = sl.printToString(sm);
         const char *name = (*i).first->getNameStart();
 
+        if (!config.filter.accept_macro(sm, name, sl)) continue;
+
+        std::string loc = sl.printToString(sm);
+
         if (mi->isBuiltinMacro() || loc.substr(0, 10) == "<built-in>") {
         } else if (mi->isFunctionLike()) {
         } else if (macro_type(pp, name, mi) && config.with_macro_defs) {
@@ -214,9 +217,12 @@ void c2ffi::process_macros(clang::CompilerInstance &ci, std::ostream &os,
          i != pp.macro_end(); i++) {
         clang::MacroInfo *mi = i->getSecond().getLatest()->getMacroInfo();
         clang::SourceLocation sl = mi->getDefinitionLoc();
-        std::string loc = sl.printToString(sm);
         const char *name = (*i).first->getNameStart();
 
+        if (!config.filter.accept_macro(sm, name, sl)) continue;
+
+        std::string loc = sl.printToString(sm);
+
         if (mi->isBuiltinMacro() || loc.substr(0, 10) == "<built-in>") {
         } else if (mi->isFunctionLike()) {
         } else if (best_guess type = macro_type(pp, name, mi)) {
@@ -0,0 +1,205 @@
+/*
+    c2ffi
+    Copyright (C) 2013  Ryan Pavlik
+
+    This file is part of c2ffi.
+
+    c2ffi is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    c2ffi is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+
+#include <clang/AST/Decl.h>
+#include <clang/Basic/FileManager.h>
+
+#include "c2ffi.h"
+#include "c2ffi/filter.h"
+
+using namespace c2ffi;
+
+llvm::StringRef c2ffi::identifier_name(const clang::NamedDecl *d) {
+    if (d && d->getDeclName().isIdentifier())
+        return d->getName();
+
+    return llvm::StringRef();
+}
+
+static std::string normalize_path(llvm::StringRef p) {
+    llvm::SmallString<256> path(p);
+
+    llvm::sys::fs::make_absolute(path);
+    llvm::sys::path::remove_dots(path, true);
+
+    return std::string(path.begin(), path.end());
+}
+
+std::string c2ffi::file_path(const clang::SourceManager &sm,
+                             clang::SourceLocation loc) {
+    if (loc.isInvalid()) return "";
+
+    clang::FileID fid = sm.getFileID(sm.getExpansionLoc(loc));
+    const clang::FileEntry *fe = sm.getFileEntryForID(fid);
+
+    if (!fe) return "";
+
+    return normalize_path(fe->getName());
+}
+
+bool DeclFilter::add_file_glob(const std::string &glob, std::string &error) {
+    llvm::Expected<llvm::GlobPattern> pat = llvm::GlobPattern::create(glob);
+
+    if (!pat) {
+        error = llvm::toString(pat.takeError());
+        return false;
+    }
+
+    _files.push_back(*pat);
+    return true;
+}
+
+bool DeclFilter::add_name_regex(const std::string &re, std::string &error) {
+    llvm::Regex r(re);
+
+    if (!r.isValid(error))
+        return false;
+
+    _names.push_back(std::move(r));
+    return true;
+}
+
+void DeclFilter::add_user_root(const std::string &dir) {
+    std::string root = normalize_path(dir);
+
+    while (root.size() > 1 && llvm::sys::path::is_separator(root.back()))
+        root.pop_back();
+
+    _user_roots.push_back(root);
+}
+
+bool DeclFilter::is_user_path(llvm::StringRef path) const {
+    for (auto &root : _user_roots) {
+        if (path.startswith(root) &&
+            (path.size() == root.size() ||
+             llvm::sys::path::is_separator(path[root.size()])))
+            return true;
+    }
+
+    return false;
+}
+
+bool DeclFilter::is_system(const clang::SourceManager &sm,
+                           clang::SourceLocation loc) const {
+    clang::FileID fid = loc.isValid() ? sm.getFileID(sm.getExpansionLoc(loc))
+                                      : clang::FileID();
+    auto it = _system_cache.find(fid.getHashValue());
+
+    if (it != _system_cache.end())
+        return it->second;
+
+    std::string path = file_path(sm, loc);
+    bool result = path.empty() || !is_user_path(path);
+
+    _system_cache[fid.getHashValue()] = result;
+    return result;
+}
+
+bool DeclFilter::match_name(llvm::StringRef name) const {
+    if (_names.empty() && _prefixes.empty())
+        return true;
+
+    for (auto &prefix : _prefixes)
+        if (name.startswith(prefix)) return true;
+
+    for (auto &re : _names)
+        if (re.match(name)) return true;
+
+    return false;
+}
+
+// Relative globs may match any trailing part of the path, so
+// 'vendor/foo/*.h' matches '/src/vendor/foo/foo.h'
+bool DeclFilter::match_path(llvm::StringRef path) const {
+    for (auto &glob : _files) {
+        if (glob.match(path)) return true;
+
+        for (size_t i = 0; i < path.size(); i++)
+            if (llvm::sys::path::is_separator(path[i]) &&
+                glob.match(path.substr(i + 1)))
+                return true;
+    }
+
+    return false;
+}
+
+bool DeclFilter::match_file(const clang::SourceManager &sm,
+                            clang::SourceLocation loc) const {
+    if (_files.empty() && _headers == headers_all)
+        return true;
+
+    clang::FileID fid = loc.isValid() ? sm.getFileID(sm.getExpansionLoc(loc))
+                                      : clang::FileID();
+    auto it = _file_cache.find(fid.getHashValue());
+
+    if (it != _file_cache.end())
+        return it->second;
+
+    std::string path = file_path(sm, loc);
+    bool result = true;
+
+    if (_headers != headers_all)
+        result = (is_user_path(path) == (_headers == headers_user));
+
+    if (result && !_files.empty())
+        result = match_path(path);
+
+    _file_cache[fid.getHashValue()] = result;
+    return result;
+}
+
+bool DeclFilter::accept(const clang::SourceManager &sm,
+                        const clang::Decl *d) const {
+    if (empty()) return true;
+
+    if (!match_file(sm, d->getLocation()))
+        return false;
+
+    const auto *nd = llvm::dyn_cast<clang::NamedDecl>(d);
+    llvm::StringRef name = identifier_name(nd);
+
+    // Macro constants from a generated -M file
+    if (name.startswith("__c2ffi_"))
+        name = name.substr(8);
+
+    if (match_name(name))
+        return true;
+
+    // Anonymous enums are selected by their constants
+    if (name.empty()) {
+        if (const auto *ed = llvm::dyn_cast<clang::EnumDecl>(d)) {
+            for (const clang::EnumConstantDecl *ecd : ed->enumerators())
+                if (match_name(identifier_name(ecd))) return true;
+        }
+    }
+
+    return false;
+}
+
+bool DeclFilter::accept_macro(const clang::SourceManager &sm,
+                              llvm::StringRef name,
+                              clang::SourceLocation loc) const {
+    return match_file(sm, loc) && match_name(name);
+}
@@ -0,0 +1,302 @@
+/*
+    c2ffi
+    Copyright (C) 2013  Ryan Pavlik
+
+    This file is part of c2ffi.
+
+    c2ffi is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    c2ffi is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string>
+
+#include <llvm/Support/MD5.h>
+
+#include "c2ffi.h"
+#include "c2ffi/fingerprint.h"
+
+using namespace c2ffi;
+
+namespace c2ffi {
+    /* Hashes a declaration as a flat stream of tokens, without writing
+       the stream out.  Strings are length-prefixed so no two different
+       declarations make the same stream. */
+    class FingerprintWriter : public OutputDriver {
+        llvm::MD5 _md5;
+
+        void tok(const char *s) {
+            _md5.update(llvm::StringRef(s));
+            _md5.update(" ");
+        }
+
+        void tok(const std::string &s) {
+            _md5.update(std::to_string(s.size()) + ':');
+            _md5.update(s);
+            _md5.update(" ");
+        }
+
+        void tok(uint64_t n) { _md5.update(std::to_string(n) + ' '); }
+
+        void tok(bool b) { _md5.update(b ? "t " : "f "); }
+
+        void write_template(const TemplateMixin &t) {
+            tok(t.is_template());
+
+            for (auto *arg : t.args()) {
+                if (arg->type()) write(*arg->type());
+                tok(arg->has_val() ? arg->val() : std::string());
+            }
+        }
+
+        void write_fields(const NameTypeVector &fields) {
+            tok((uint64_t) fields.size());
+
+            for (auto &f : fields) {
+                tok(f.first);
+                tok(f.second->bit_offset());
+                tok(f.second->bit_size());
+                tok(f.second->bit_alignment());
+                write(*f.second);
+            }
+        }
+
+        void write_functions(const FunctionVector &funcs) {
+            tok((uint64_t) funcs.size());
+
+            for (auto *f : funcs)
+                write((const Writable &) *f);
+        }
+
+        void write_function(const FunctionDecl &d) {
+            tok(d.name());
+            tok(d.is_variadic());
+            tok(d.is_inline());
+            tok(d.storage_class());
+            tok(d.is_objc_method());
+            tok(d.is_class_method());
+            write_template(d);
+            write_fields(d.fields());
+            write(d.return_type());
+        }
+
+        void write_record(const RecordDecl &d) {
+            tok(d.name());
+            tok(d.is_union());
+            tok(d.bit_size());
+            tok(d.bit_alignment());
+            write_fields(d.fields());
+        }
+
+    public:
+        FingerprintWriter() : OutputDriver(nullptr) {}
+
+        using OutputDriver::write;
+
+        // The hash of what was written since the last one
+        uint64_t result() {
+            llvm::MD5::MD5Result r;
+
+            _md5.final(r);
+            _md5 = llvm::MD5();
+            return r.low();
+        }
+
+        // Types -----------------------------------------------------------
+        void write(const SimpleType &t) override {
+            tok("simple");
+            tok(t.name());
+        }
+
+        void write(const BasicType &t) override {
+            tok("basic");
+            tok(t.name());
+            tok(t.bit_size());
+            tok(t.bit_alignment());
+        }
+
+        void write(const BitfieldType &t) override {
+            tok("bitfield");
+            tok((uint64_t) t.width());
+            write(*t.base());
+        }
+
+        void write(const PointerType &t) override {
+            tok("pointer");
+            write(t.pointee());
+        }
+
+        void write(const ReferenceType &t) override {
+            tok("reference");
+            write(t.pointee());
+        }
+
+        void write(const ArrayType &t) override {
+            tok("array");
+            tok(t.size());
+            write(t.pointee());
+        }
+
+        void write(const RecordType &t) override {
+            tok(t.is_union() ? "union" : (t.is_class() ? "class" : "struct"));
+            tok(t.name());
+            write_template(t);
+        }
+
+        void write(const EnumType &t) override {
+            tok("enum");
+            tok(t.name());
+        }
+
+        // Decls -----------------------------------------------------------
+        void write(const UnhandledDecl &d) override {
+            tok("unhandled");
+            tok(d.name());
+            tok(d.kind());
+        }
+
+        void write(const VarDecl &d) override {
+            tok("var");
+            tok(d.name());
+            tok(d.is_extern());
+            tok(d.value());
+            write(d.type());
+        }
+
+        void write(const FunctionDecl &d) override {
+            tok("function");
+            write_function(d);
+        }
+
+        void write(const TypedefDecl &d) override {
+            tok("typedef");
+            tok(d.name());
+            write(d.type());
+        }
+
+        void write(const RecordDecl &d) override {
+            tok("record");
+            write_record(d);
+        }
+
+        void write(const EnumDecl &d) override {
+            tok("enum");
+            tok(d.name());
+
+            for (auto &f : d.fields()) {
+                tok(f.first);
+                tok(f.second);
+            }
+        }
+
+        void write(const CXXRecordDecl &d) override {
+            tok("cxx-record");
+            tok(d.is_class());
+            write_record(d);
+            write_template(d);
+
+            for (auto &p : d.parents()) {
+                tok(p.name);
+                tok((uint64_t) p.access);
+                tok((uint64_t) p.parent_offset);
+                tok(p.is_virtual);
+            }
+
+            write_functions(d.functions());
+        }
+
+        void write(const CXXFunctionDecl &d) override {
+            tok("cxx-function");
+            tok(d.is_static());
+            tok(d.is_virtual());
+            tok(d.is_const());
+            tok(d.is_pure());
+            write_function(d);
+        }
+
+        void write(const CXXNamespaceDecl &d) override {
+            tok("namespace");
+            tok(d.name());
+        }
+
+        void write(const TypeAliasDecl &d) override {
+            tok("type-alias");
+            tok(d.name());
+            write(d.type());
+        }
+
+        void write(const TypeAliasTemplateDecl &d) override {
+            tok("type-alias-template");
+            tok(d.name());
+            write(d.type());
+            write_template(d);
+        }
+
+        void write(const VarTemplateDecl &d) override {
+            tok("var-template");
+            tok(d.name());
+            tok(d.value());
+            write(d.type());
+            write_template(d);
+        }
+
+        void write(const UsingDecl &d) override {
+            tok("using");
+            tok(d.name());
+        }
+
+        void write(const UsingShadowDecl &d) override {
+            tok("using-shadow");
+            tok(d.name());
+        }
+
+        void write(const UsingDirectiveDecl &d) override {
+            tok("using-directive");
+            tok(d.name());
+        }
+
+        void write(const ObjCInterfaceDecl &d) override {
+            tok("@interface");
+            tok(d.name());
+            tok(d.super());
+            tok(d.is_forward());
+
+            for (auto &p : d.protocols())
+                tok(p);
+
+            write_fields(d.fields());
+            write_functions(d.functions());
+        }
+
+        void write(const ObjCCategoryDecl &d) override {
+            tok("@category");
+            tok(d.name());
+            tok(d.category());
+            write_functions(d.functions());
+        }
+
+        void write(const ObjCProtocolDecl &d) override {
+            tok("@protocol");
+            tok(d.name());
+            write_functions(d.functions());
+        }
+    };
+}
+
+Fingerprinter::Fingerprinter() : _w(new FingerprintWriter) {}
+
+Fingerprinter::~Fingerprinter() = default;
+
+uint64_t Fingerprinter::operator()(const Decl &d) {
+    _w->write(d);
+    return _w->result();
+}
@@ -0,0 +1,427 @@
+/*
+    c2ffi
+    Copyright (C) 2013  Ryan Pavlik
+
+    This file is part of c2ffi.
+
+    c2ffi is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    c2ffi is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cctype>
+
+#include <llvm/Support/Error.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/MD5.h>
+
+#include <clang/Lex/PPCallbacks.h>
+
+#include "c2ffi.h"
+#include "c2ffi/ast.h"
+#include "c2ffi/deps.h"
+#include "c2ffi/filter.h"
+#include "c2ffi/incremental.h"
+#include "c2ffi/spec.h"
+
+using namespace c2ffi;
+
+// Notes each macro a file expands or tests
+class Incremental::Watcher : public clang::PPCallbacks {
+    Incremental &_inc;
+    const clang::SourceManager &_sm;
+
+    void use(clang::SourceLocation loc, const clang::Token &name,
+             const clang::MacroDefinition &md) {
+        _inc.use_macro(_sm, loc, name.getIdentifierInfo(), md.getMacroInfo());
+    }
+
+public:
+    Watcher(Incremental &inc, const clang::SourceManager &sm)
+            : _inc(inc), _sm(sm) {}
+
+    void MacroExpands(const clang::Token &name, const clang::MacroDefinition &md,
+                      clang::SourceRange range, const clang::MacroArgs *) override {
+        use(range.getBegin(), name, md);
+    }
+
+    void Defined(const clang::Token &name, const clang::MacroDefinition &md,
+                 clang::SourceRange range) override {
+        use(range.getBegin(), name, md);
+    }
+
+    void Ifdef(clang::SourceLocation loc, const clang::Token &name,
+               const clang::MacroDefinition &md) override {
+        use(loc, name, md);
+    }
+
+    void Ifndef(clang::SourceLocation loc, const clang::Token &name,
+                const clang::MacroDefinition &md) override {
+        use(loc, name, md);
+    }
+};
+
+static clang::FileID file_of(const clang::SourceManager &sm,
+                             clang::SourceLocation loc) {
+    return loc.isValid() ? sm.getFileID(sm.getExpansionLoc(loc))
+                         : clang::FileID();
+}
+
+static unsigned offset_of(const clang::SourceManager &sm,
+                          clang::SourceLocation loc) {
+    return loc.isValid() ? sm.getFileOffset(sm.getExpansionLoc(loc)) : 0;
+}
+
+/* Rewrites the number of every "id" and "ns" key in text through ids.
+   False if one of them isn't there; 0, meaning none, stays. */
+static bool renumber(llvm::StringRef text,
+                     const std::map<unsigned int, unsigned int> &ids,
+                     std::string &out) {
+    size_t i = 0;
+
+    out.clear();
+    out.reserve(text.size());
+
+    while (i < text.size()) {
+        if (text[i] != '"') {
+            out += text[i++];
+            continue;
+        }
+
+        size_t end = i + 1;
+        while (end < text.size() && text[end] != '"')
+            end += text[end] == '\\' ? 2 : 1;
+
+        llvm::StringRef s = text.slice(i, end + 1);
+        out += s;
+        i = std::min(end + 1, text.size());
+
+        if (s != "\"id\"" && s != "\"ns\"") continue;
+
+        // Only as a key, not a value
+        size_t j = i;
+        while (j < text.size() && isspace((unsigned char) text[j])) j++;
+        if (j == text.size() || text[j] != ':') continue;
+
+        j++;
+        while (j < text.size() && isspace((unsigned char) text[j])) j++;
+
+        size_t k = j;
+        while (k < text.size() && isdigit((unsigned char) text[k])) k++;
+
+        unsigned long long old;
+        if (text.slice(j, k).getAsInteger(10, old)) continue;
+
+        unsigned int id = 0;
+
+        if (old) {
+            auto it = ids.find((unsigned int) old);
+            if (it == ids.end()) return false;
+
+            id = it->second;
+        }
+
+        out += text.slice(i, j);
+        out += std::to_string(id);
+        i = k;
+    }
+
+    return true;
+}
+
+void Incremental::load(const std::string &path) {
+    SpecReader in(path);
+    std::string text;
+    PrevRun *cur = nullptr;
+
+    if (!in.is_open()) return;
+
+    while (in.next(text)) {
+        if (spec_tag(text) != "file") {
+            // Anything before the first file marker (e.g. the namespace)
+            // is written again anyway
+            if (cur) cur->decls.push_back(text);
+            continue;
+        }
+
+        cur = nullptr;
+
+        llvm::Expected<llvm::json::Value> v = llvm::json::parse(text);
+        if (!v) {
+            llvm::consumeError(v.takeError());
+            continue;
+        }
+
+        const llvm::json::Object *o = v->getAsObject();
+        if (!o) continue;
+
+        llvm::Optional<llvm::StringRef> key = o->getString("key");
+        const llvm::json::Array *ids = o->getArray("ids");
+
+        // Output from before runs had keys is never copied
+        if (!key || key->empty() || !ids) continue;
+
+        cur = &_prev[key->str()];
+
+        for (auto &e : *ids) {
+            const llvm::json::Array *pair = e.getAsArray();
+            if (!pair || pair->size() != 2) continue;
+
+            llvm::Optional<int64_t> id = (*pair)[0].getAsInteger();
+            llvm::Optional<llvm::StringRef> k = (*pair)[1].getAsString();
+
+            if (id && k) cur->ids[(unsigned int) *id] = k->str();
+        }
+    }
+}
+
+void Incremental::watch(clang::Preprocessor &pp) {
+    pp.addPPCallbacks(std::unique_ptr<clang::PPCallbacks>(
+            new Watcher(*this, pp.getSourceManager())));
+}
+
+const Incremental::FileInfo &Incremental::file(const clang::SourceManager &sm,
+                                               clang::FileID fid) {
+    auto it = _files.find(fid);
+
+    if (it != _files.end())
+        return it->second;
+
+    FileInfo &f = _files[fid];
+
+    if (fid.isInvalid())
+        return f;
+
+    f.path = file_path(sm, sm.getLocForStartOfFile(fid));
+
+    // Buffers without a file (the predefines) are hashed too, for the
+    // macros defined there
+    bool invalid = false;
+    llvm::StringRef data = sm.getBufferData(fid, &invalid);
+
+    if (!invalid) {
+        llvm::MD5 md5;
+        llvm::MD5::MD5Result result;
+
+        md5.update(data);
+        md5.final(result);
+        f.hash = result.digest().str().str();
+    }
+
+    return f;
+}
+
+void Incremental::use_macro(const clang::SourceManager &sm,
+                            clang::SourceLocation loc,
+                            const clang::IdentifierInfo *name,
+                            const clang::MacroInfo *mi) {
+    clang::FileID fid = file_of(sm, loc);
+    const void *what = mi ? (const void *) mi : (const void *) name;
+
+    if (!name || !_macros_seen.insert({fid, what}).second)
+        return;
+
+    std::string use = name->getName().str() + "=";
+
+    if (!mi) {
+        use += "-";
+    } else if (mi->isBuiltinMacro()) {
+        use += "builtin";
+    } else {
+        clang::SourceLocation def = mi->getDefinitionLoc();
+
+        use += file(sm, file_of(sm, def)).hash + ":"
+               + std::to_string(offset_of(sm, def));
+    }
+
+    _macros[fid].insert(use);
+}
+
+/* Follows everything decls refer to, however indirectly, noting which
+   files refer to which.  Declarations left out of the output count
+   too, as their layout still shows through. */
+void Incremental::add_refs(const clang::SourceManager &sm,
+                           const std::vector<const DeferredDecl *> &decls) {
+    ClangDeclSet seen;
+    ClangDeclVector work, deps;
+
+    for (auto *dd : decls)
+        work.push_back(dd->d);
+
+    while (!work.empty()) {
+        const clang::Decl *d = work.back();
+        work.pop_back();
+
+        if (!seen.insert(d).second) continue;
+
+        const clang::Decl *def = decl_definition(d);
+
+        deps.clear();
+        deps.push_back(def);
+        decl_deps(def, deps);
+
+        for (const clang::DeclContext *dc = d->getDeclContext(); dc;
+             dc = dc->getParent())
+            if_const_cast(nd, clang::NamespaceDecl, dc)
+                deps.push_back(nd);
+
+        clang::FileID from = file_of(sm, d->getLocation());
+
+        for (const clang::Decl *dep : deps) {
+            clang::FileID to = file_of(sm, dep->getLocation());
+
+            if (to != from) _refs[from].insert(to);
+            work.push_back(dep);
+        }
+    }
+}
+
+std::string Incremental::run_key(const clang::SourceManager &sm,
+                                 clang::FileID fid,
+                                 const DeferredDecl *const *run, size_t n) {
+    std::set<clang::FileID> seen = {fid};
+    std::vector<clang::FileID> work = {fid};
+
+    while (!work.empty()) {
+        clang::FileID f = work.back();
+        work.pop_back();
+
+        auto refs = _refs.find(f);
+        if (refs == _refs.end()) continue;
+
+        for (clang::FileID to : refs->second)
+            if (seen.insert(to).second) work.push_back(to);
+    }
+
+    // FileIDs are numbered in the order files are entered, so each is
+    // identified by what it is instead
+    std::vector<std::string> files;
+
+    for (clang::FileID f : seen) {
+        const FileInfo &info = file(sm, f);
+        std::string s = info.path + '\n' + info.hash + '\n';
+
+        for (auto &use : _macros[f])
+            s += use + ' ';
+
+        files.push_back(s);
+    }
+
+    std::sort(files.begin(), files.end());
+
+    llvm::MD5 md5;
+    llvm::MD5::MD5Result result;
+
+    md5.update(_options);
+    md5.update(std::to_string(n) + " "
+               + std::to_string(offset_of(sm, run[0]->d->getLocation())) + " "
+               + std::to_string(offset_of(sm, run[n - 1]->d->getLocation())) + "\n");
+
+    for (auto &s : files)
+        md5.update(s);
+
+    md5.final(result);
+    return result.digest().str().str();
+}
+
+bool Incremental::splice(C2FFIASTConsumer &ast, const FileInfo &f,
+                         const std::string &key, const PrevRun &prev,
+                         const DeferredDecl *const *run, size_t n) {
+    std::map<unsigned int, unsigned int> ids;
+    SourceFileDecl::IdVector table;
+
+    for (auto &e : prev.ids) {
+        unsigned int id = ast.key_id(e.second);
+
+        ids[e.first] = id;
+        table.push_back({id, e.second});
+    }
+
+    std::vector<std::string> texts(prev.decls.size());
+
+    for (size_t i = 0; i < texts.size(); i++)
+        if (!renumber(prev.decls[i], ids, texts[i])) return false;
+
+    for (size_t i = 0; i < n; i++)
+        ast.write_deps(run[i]->d);
+
+    ast.emit(new SourceFileDecl(f.path, f.hash, key, table));
+
+    for (auto &text : texts)
+        ast.emit(new RawDecl(std::move(text)));
+
+    return true;
+}
+
+void Incremental::write_run(C2FFIASTConsumer &ast, clang::FileID fid,
+                            const DeferredDecl *const *run, size_t n) {
+    const clang::SourceManager &sm = ast.ci().getSourceManager();
+    const FileInfo &f = file(sm, fid);
+    std::string key = f.path.empty() ? std::string()
+                                     : run_key(sm, fid, run, n);
+
+    auto prev = key.empty() ? _prev.end() : _prev.find(key);
+
+    if (prev != _prev.end()) {
+        bool copied = splice(ast, f, key, prev->second, run, n);
+
+        _prev.erase(prev);
+        if (copied) return;
+    }
+
+    // The marker lists the ids used, so it waits until they are known
+    std::vector<Decl *> held;
+    std::set<unsigned int> used;
+
+    ast.hold(&held, &used);
+
+    for (size_t i = 0; i < n; i++)
+        ast.process(*run[i]);
+
+    ast.hold(nullptr, nullptr);
+
+    SourceFileDecl::IdVector table;
+
+    for (unsigned int id : used)
+        table.push_back({id, ast.key_of(id)});
+
+    ast.emit(new SourceFileDecl(f.path, f.hash, key, table));
+
+    for (Decl *d : held)
+        ast.emit(d);
+}
+
+void Incremental::emit(C2FFIASTConsumer &ast,
+                       const std::vector<const DeferredDecl *> &decls) {
+    const clang::SourceManager &sm = ast.ci().getSourceManager();
+    size_t end;
+
+    add_refs(sm, decls);
+
+    for (size_t i = 0; i < decls.size(); i = end) {
+        clang::FileID fid = file_of(sm, decls[i]->d->getLocation());
+
+        for (end = i + 1; end < decls.size(); end++)
+            if (file_of(sm, decls[end]->d->getLocation()) != fid) break;
+
+        // What goes to the base spec is always built
+        if (ast.to_base(decls[i]->d)) {
+            for (size_t j = i; j < end; j++)
+                ast.process(*decls[j]);
+
+            continue;
+        }
+
+        write_run(ast, fid, &decls[i], end - i);
+    }
+}
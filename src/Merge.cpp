@@ -0,0 +1,278 @@
+/*
+    c2ffi
+    Copyright (C) 2013  Ryan Pavlik
+
+    This file is part of c2ffi.
+
+    c2ffi is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    c2ffi is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/Support/Error.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/MD5.h>
+
+#include "c2ffi/spec.h"
+
+using namespace c2ffi;
+
+namespace {
+    struct MergedDecl {
+        uint64_t content;
+        unsigned long id;
+    };
+
+    typedef std::unordered_map<uint64_t, MergedDecl> MergedDeclMap;
+    typedef std::map<unsigned long, unsigned long> IdMap;
+}
+
+static uint64_t hash64(llvm::StringRef s) {
+    llvm::MD5 md5;
+    llvm::MD5::MD5Result result;
+
+    md5.update(s);
+    md5.final(result);
+    return result.low();
+}
+
+// Calls fn(depth, is_id, value) on every "id" and "ns" number in text
+// and replaces the number with its result.  Depth 1 is the top-level
+// object.
+template<typename Fn>
+static std::string renumber(const std::string &text, Fn fn) {
+    static const llvm::StringRef keys[] = {"\"id\": ", "\"ns\": "};
+    std::string out;
+    unsigned depth = 0;
+    bool in_string = false;
+
+    out.reserve(text.size());
+
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+
+        if (in_string) {
+            out += c;
+
+            if (c == '\\' && i + 1 < text.size())
+                out += text[++i];
+            else if (c == '"')
+                in_string = false;
+
+            continue;
+        }
+
+        if (c == '{') depth++;
+        else if (c == '}') depth--;
+
+        if (c == '"') {
+            llvm::StringRef rest = llvm::StringRef(text).substr(i);
+
+            for (auto &k : keys) {
+                if (!rest.startswith(k)) continue;
+
+                size_t j = i + k.size();
+                unsigned long value = 0;
+
+                while (j < text.size() && isdigit((unsigned char)text[j]))
+                    value = value * 10 + (text[j++] - '0');
+
+                out += k;
+                out += std::to_string(fn(depth, &k == keys, value));
+                i = j - 1;
+                break;
+            }
+
+            if (i < text.size() && text[i] != '"') continue;
+
+            in_string = true;
+        }
+
+        out += c;
+    }
+
+    return out;
+}
+
+/* Identity of a declaration: its tag, name and location.  Those
+   written without a location, namespaces for one, go by their USR
+   instead, or else by the (merged) id of the namespace they are in, so
+   a::detail and b::detail stay apart. */
+static uint64_t identity(const std::string &text, unsigned long parent) {
+    std::string key = spec_tag(text).str();
+    llvm::Expected<llvm::json::Value> v = llvm::json::parse(text);
+
+    if (!v) {
+        llvm::consumeError(v.takeError());
+        return hash64(text);
+    }
+
+    if (const llvm::json::Object *o = v->getAsObject()) {
+        if (llvm::Optional<llvm::StringRef> name = o->getString("name"))
+            key += "\n" + name->str();
+
+        if (llvm::Optional<llvm::StringRef> loc = o->getString("location"))
+            key += "\n" + loc->str();
+        else if (llvm::Optional<llvm::StringRef> usr = o->getString("usr"))
+            key += "\nusr " + usr->str();
+        else
+            key += "\nin " + std::to_string(parent);
+    }
+
+    return hash64(key);
+}
+
+/* c2ffi merge [-o OUTPUT] INPUT...
+ *
+ * Streams json outputs into one, writing each declaration the first time
+ * it is seen.  Declarations are identified by tag, name and location
+ * (see identity()), and only 64-bit hashes of the identity and content
+ * are kept per declaration, never the text.  A declaration seen again with different
+ * content is a conflict: it is reported and the first definition kept.
+ *
+ * Record and namespace ids are renumbered so they stay unique in the
+ * merged output, and references to a duplicate are pointed at the kept
+ * declaration.  Each input is read twice for this: once to find its
+ * duplicates, and once to write it.
+ */
+int c2ffi::spec_merge(int argc, char *argv[]) {
+    std::ofstream file;
+    std::ostream *os = &std::cout;
+    int first = 1;
+
+    if (argc > 2 && std::string(argv[1]) == "-o") {
+        file.open(argv[2]);
+
+        if (!file.is_open()) {
+            std::cerr << "Error: cannot write " << argv[2] << std::endl;
+            return 1;
+        }
+
+        os = &file;
+        first = 3;
+    }
+
+    if (first >= argc) {
+        std::cerr << "Usage: c2ffi merge [-o OUTPUT] INPUT..." << std::endl;
+        return 1;
+    }
+
+    MergedDeclMap seen;
+    unsigned long next_id = 0;
+    unsigned long conflicts = 0;
+    bool mid = false;
+
+    *os << "[\n";
+
+    for (int i = first; i < argc; i++) {
+        SpecReader in(argv[i]);
+        IdMap ids;
+        std::string text;
+
+        // Whether each declaration of the shard is written, in order
+        std::vector<bool> keep;
+
+        if (!in.is_open()) {
+            std::cerr << "Error: cannot read " << argv[i] << std::endl;
+            return 1;
+        }
+
+        auto map_id = [&](unsigned long id) -> unsigned long {
+            if (!id) return 0;
+
+            auto it = ids.find(id);
+            if (it != ids.end()) return it->second;
+
+            return ids[id] = ++next_id;
+        };
+
+        // First every duplicate is found, so a reference to one ahead of
+        // it in the shard goes to the kept copy too
+        while (in.next(text)) {
+            // File markers from --incremental do not survive a merge
+            if (spec_tag(text) == "file") continue;
+
+            if (spec_tag(text) == "type" || spec_tag(text) == "source") {
+                std::cerr << "Error: " << argv[i] << " was written with "
+                          << "--type-table or --file-table, which merge "
+                          << "does not support" << std::endl;
+                return 1;
+            }
+
+            unsigned long own = 0, parent = 0;
+            std::string plain = renumber(text, [&](unsigned depth, bool is_id, unsigned long v) {
+                if (depth == 1) (is_id ? own : parent) = v;
+                return 0ul;
+            });
+
+            uint64_t key = identity(text, map_id(parent));
+            uint64_t content = hash64(plain);
+            auto it = seen.find(key);
+
+            if (it == seen.end()) {
+                seen[key] = {content, map_id(own)};
+                keep.push_back(true);
+                continue;
+            }
+
+            if (it->second.content != content) {
+                std::cerr << "Warning: conflicting definition of "
+                          << spec_tag(text).str() << " in " << argv[i]
+                          << " ignored: " << text << std::endl;
+                conflicts++;
+            }
+
+            // References to this shard's copy go to the kept one
+            if (own && it->second.id && !ids.count(own))
+                ids[own] = it->second.id;
+
+            keep.push_back(false);
+        }
+
+        SpecReader again(argv[i]);
+        size_t n = 0;
+
+        if (!again.is_open()) {
+            std::cerr << "Error: cannot read " << argv[i] << std::endl;
+            return 1;
+        }
+
+        while (again.next(text)) {
+            if (spec_tag(text) == "file") continue;
+            if (n >= keep.size() || !keep[n++]) continue;
+
+            text = renumber(text, [&](unsigned, bool, unsigned long v) {
+                return map_id(v);
+            });
+
+            if (mid) *os << ",\n";
+            *os << text;
+            mid = true;
+        }
+    }
+
+    *os << "\n]\n";
+    os->flush();
+
+    if (conflicts)
+        std::cerr << "Warning: " << conflicts << " conflicting definitions" << std::endl;
+
+    return 0;
+}
@@ -29,14 +29,34 @@ namespace c2ffi {
 
     OutputDriver *MakeJSONOutputDriver(std::ostream *os);
 
+    OutputDriver *MakeNDJSONOutputDriver(std::ostream *os);
+
     OutputDriver *MakeSexpOutputDriver(std::ostream *os);
 
+    OutputDriver *MakeCBOROutputDriver(std::ostream *os);
+
+    OutputDriver *MakeMMSpecOutputDriver(std::ostream *os);
+
+#ifdef C2FFI_HAVE_SQLITE
+    OutputDriver *MakeSQLiteOutputDriver(std::ostream *os);
+#endif
+
     OutputDriverField OutputDrivers[] = {
-            {"json",  &MakeJSONOutputDriver},
-            {"sexp",  &MakeSexpOutputDriver},
-            {"null",  &MakeNullOutputDriver},
+            {"json",   &MakeJSONOutputDriver},
+            {"ndjson", &MakeNDJSONOutputDriver},
+            {"sexp",   &MakeSexpOutputDriver},
+            {"cbor",   &MakeCBOROutputDriver},
+            {"mmspec", &MakeMMSpecOutputDriver},
+#ifdef C2FFI_HAVE_SQLITE
+            {"sqlite", &MakeSQLiteOutputDriver},
+#endif
+            {"null",   &MakeNullOutputDriver},
             {nullptr, nullptr}
     };
 }
 
-/***********************************************************************/
\ No newline at end of file
+/***********************************************************************/
+
+void c2ffi::OutputDriver::write_decl(const Decl &d) {
+    write(d);
+}
@@ -0,0 +1,95 @@
+/*
+    c2ffi
+    Copyright (C) 2013  Ryan Pavlik
+
+    This file is part of c2ffi.
+
+    c2ffi is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    c2ffi is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "c2ffi.h"
+#include "c2ffi/pipeline.h"
+
+using namespace c2ffi;
+
+void DeclPipeline::start() {
+    _thread = std::thread(&DeclPipeline::run, this);
+}
+
+// Yields this many times before sleeping
+static const int spin_limit = 64;
+
+template<typename Ready>
+void DeclPipeline::wait(Ready ready) {
+    for (int i = 0; i < spin_limit; i++) {
+        if (ready()) return;
+        std::this_thread::yield();
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    _sleeping.store(true, std::memory_order_relaxed);
+
+    // Pairs with the fence in wake(): either we see the other side's
+    // change, or it sees _sleeping and notifies under the lock
+    _cv.wait(lock, [&] {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return ready();
+    });
+
+    _sleeping.store(false, std::memory_order_relaxed);
+}
+
+void DeclPipeline::wake() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (_sleeping.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _cv.notify_one();
+    }
+}
+
+void DeclPipeline::push(Decl *d) {
+    while (!_queue.try_push(d))
+        wait([this] { return !_queue.full(); });
+
+    wake();
+}
+
+void DeclPipeline::finish() {
+    if (!_thread.joinable()) return;
+
+    // A null declaration tells the serializer to stop
+    push(nullptr);
+    _thread.join();
+}
+
+void DeclPipeline::run() {
+    bool mid = false;
+    Decl *d = nullptr;
+
+    for (;;) {
+        while (!_queue.try_pop(d))
+            wait([this] { return !_queue.empty(); });
+
+        wake();
+
+        if (!d) break;
+
+        if (mid) _od.write_between();
+        else mid = true;
+
+        _od.write_decl(*d);
+        delete d;
+    }
+}
@@ -0,0 +1,71 @@
+/*
+    c2ffi
+    Copyright (C) 2013  Ryan Pavlik
+
+    This file is part of c2ffi.
+
+    c2ffi is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    c2ffi is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdio>
+
+#include "c2ffi/sink.h"
+
+using namespace c2ffi;
+
+// Without a stream, output is counted and dropped
+void OutputSink::drain() {
+    if (_len && _os) _os->write(_buf.get(), _len);
+
+    _written += _len;
+    _len = 0;
+}
+
+void OutputSink::make_room() {
+    drain();
+
+    if (!_size) {
+        _buf.reset(new char[capacity]);
+        _size = capacity;
+    }
+}
+
+void OutputSink::flush() {
+    drain();
+
+    if (_os) _os->flush();
+}
+
+OutputSink &OutputSink::write_unsigned(unsigned long long v, bool negative) {
+    char digits[24];
+    char *p = digits + sizeof(digits);
+
+    do {
+        *--p = (char) ('0' + v % 10);
+        v /= 10;
+    } while (v);
+
+    if (negative) *--p = '-';
+
+    write(p, digits + sizeof(digits) - p);
+    return *this;
+}
+
+OutputSink &OutputSink::operator<<(double v) {
+    char digits[32];
+    int n = snprintf(digits, sizeof(digits), "%g", v);
+
+    if (n > 0) write(digits, (size_t) n);
+    return *this;
+}
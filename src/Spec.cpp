@@ -0,0 +1,65 @@
+/*
+    c2ffi
+    Copyright (C) 2013  Ryan Pavlik
+
+    This file is part of c2ffi.
+
+    c2ffi is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    c2ffi is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "c2ffi/spec.h"
+
+using namespace c2ffi;
+
+bool SpecReader::next(std::string &text) {
+    while (std::getline(_in, text)) {
+        while (!text.empty() &&
+               (text.back() == ',' || text.back() == '\r' || text.back() == ' '))
+            text.pop_back();
+
+        if (text.empty() || text == "[" || text == "]")
+            continue;
+
+        return true;
+    }
+
+    return false;
+}
+
+llvm::StringRef c2ffi::spec_tag(llvm::StringRef text) {
+    static const llvm::StringRef prefix = "{ \"tag\": \"";
+
+    if (!text.startswith(prefix))
+        return llvm::StringRef();
+
+    text = text.substr(prefix.size());
+    return text.substr(0, text.find('"'));
+}
+
+llvm::StringRef c2ffi::spec_string(llvm::StringRef text, llvm::StringRef key) {
+    std::string prefix = "\"" + key.str() + "\": \"";
+    size_t start = text.find(prefix);
+
+    if (start == llvm::StringRef::npos)
+        return llvm::StringRef();
+
+    start += prefix.size();
+
+    for (size_t i = start; i < text.size(); i++) {
+        if (text[i] == '\\') i++;
+        else if (text[i] == '"') return text.slice(start, i);
+    }
+
+    return llvm::StringRef();
+}
@@ -85,7 +85,10 @@ Type *Type::make_type(C2FFIASTConsumer *ast, const clang::Type *t) {
 
     if_const_cast(td, clang::TypedefType, t) {
         const clang::TypedefNameDecl *tdd = td->getDecl();
-        return new SimpleType(ci, td, tdd->getDeclName().getAsString());
+        auto *st = new SimpleType(ci, td, tdd->getDeclName().getAsString());
+
+        st->set_usr(ast->usr(tdd));
+        return st;
     }
 
     if_const_cast(tt, clang::SubstTemplateTypeParmType, t) {
@@ -133,6 +136,7 @@ Type *Type::make_type(C2FFIASTConsumer *ast, const clang::Type *t) {
             auto *rec = new RecordType(ast, t, name, rd->isUnion(), rd->isClass());
 
             rec->set_id(ast->decl_id(rd));
+            rec->set_usr(ast->usr(rd));
 
             return rec;
         }
@@ -156,6 +160,8 @@ Type *Type::make_type(C2FFIASTConsumer *ast, const clang::Type *t) {
             if (name.empty())
                 et->set_id(ast->decl_id(ed->getDecl()));
 
+            et->set_usr(ast->usr(ed->getDecl()));
+
             return et;
         }
     }
@@ -39,6 +39,8 @@
 #include "c2ffi/opt.h"
 #include "c2ffi/ast.h"
 #include "c2ffi/macros.h"
+#include "c2ffi/pipeline.h"
+#include "c2ffi/spec.h"
 
 using namespace c2ffi;
 
@@ -46,6 +48,11 @@ int main(int argc, char *argv[]) {
     clang::CompilerInstance ci;
     c2ffi::config sys;
 
+    if (argc > 1 && std::string(argv[1]) == "diff")
+        return spec_diff(argc - 1, argv + 1);
+    if (argc > 1 && std::string(argv[1]) == "merge")
+        return spec_merge(argc - 1, argv + 1);
+
     process_args(sys, argc, argv);
     init_ci(sys, ci);
 
@@ -81,10 +88,39 @@ int main(int argc, char *argv[]) {
         if (!sys.to_namespace.empty())
             sys.od->write_namespace(sys.to_namespace);
 
+        if (!sys.base_spec.empty())
+            sys.od->write_base(sys.base_spec);
+
+        if (sys.base_od) {
+            sys.base_od->write_header();
+
+            if (!sys.to_namespace.empty())
+                sys.base_od->write_namespace(sys.to_namespace);
+        }
+
+        if (sys.incremental)
+            sys.incremental->watch(ci.getPreprocessor());
+
+        DeclPipeline pipeline(*sys.od);
+
+        if (sys.async_output) {
+            pipeline.start();
+            astc->set_pipeline(&pipeline);
+        }
+
         clang::ParseAST(ci.getPreprocessor(), astc, ci.getASTContext());
         astc->PostProcess();
+        pipeline.finish();
         sys.od->write_footer();
 
+        if (sys.base_od) {
+            sys.base_od->write_footer();
+            sys.base_od->os().flush();
+
+            if (sys.base_compressed && !sys.base_compressed->finish())
+                return 1;
+        }
+
         if (sys.macro_output) {
             process_macros(ci, *sys.macro_output, sys);
             sys.macro_output->close();
@@ -92,10 +128,21 @@ int main(int argc, char *argv[]) {
 
         if (sys.template_output)
             sys.template_output->close();
+
+        if (sys.deps_output)
+            sys.deps_output->close();
     }
 
     ci.getDiagnosticClient().EndSourceFile();
-    sys.output->flush();
+
+    sys.od->os().flush();
+
+    if (sys.compressed) {
+        if (!sys.compressed->finish())
+            return 1;
+    } else {
+        sys.output->flush();
+    }
 
     return 0;
 }
@@ -0,0 +1,675 @@
+/* -*- c++ -*-
+
+   c2ffi
+   Copyright (C) 2013  Ryan Pavlik
+
+   This file is part of c2ffi.
+
+   c2ffi is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   c2ffi is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "c2ffi.h"
+
+using namespace c2ffi;
+
+/* CBOR (RFC 7049) output.  The output is one indefinite-length array
+   holding a map per declaration.  Maps are keyed by the small integers
+   below rather than strings, and "tag" values are the integers below
+   too, except that builtin and other simple types are written as
+   tag_simple or tag_basic with their json tag as "name".  Everything
+   else is written as json writes it: integers as integers, flags as
+   booleans, names and locations as text. */
+namespace {
+    enum Key {
+        key_tag = 0,
+        key_name,
+        key_ns,
+        key_id,
+        key_location,
+        key_usr,
+        key_fingerprint,
+        key_type,
+        key_value,
+        key_bit_size,
+        key_bit_alignment,
+        key_bit_offset,
+        key_fields,
+        key_parameters,
+        key_return_type,
+        key_variadic,
+        key_inline,
+        key_storage_class,
+        key_scope,
+        key_virtual,
+        key_pure,
+        key_const,
+        key_template,
+        key_parents,
+        key_methods,
+        key_offset,
+        key_is_virtual,
+        key_access,
+        key_width,
+        key_size,
+        key_kind,
+        key_superclass,
+        key_protocols,
+        key_ivars,
+        key_category,
+        key_text,
+        key_path,
+        key_hash
+    };
+
+    enum Tag {
+        // Declarations
+        tag_unhandled = 0,
+        tag_const,
+        tag_extern,
+        tag_function,
+        tag_typedef,
+        tag_struct,
+        tag_union,
+        tag_class,
+        tag_enum,
+        tag_namespace,
+        tag_type_alias,
+        tag_type_alias_template,
+        tag_var_template,
+        tag_using,
+        tag_using_shadow,
+        tag_using_directive,
+        tag_objc_class,
+        tag_objc_interface,
+        tag_objc_category,
+        tag_objc_protocol,
+
+        // Parts of declarations, and other records
+        tag_field = 32,
+        tag_parameter,
+        tag_parent,
+        tag_comment,
+        tag_base,
+        tag_file,
+        tag_forward,
+
+        // Types
+        tag_simple = 64,
+        tag_basic,
+        tag_bitfield,
+        tag_pointer,
+        tag_reference,
+        tag_array,
+        tag_struct_type,
+        tag_union_type,
+        tag_class_type,
+        tag_enum_type
+    };
+
+    enum {
+        major_unsigned = 0,
+        major_negative = 1,
+        major_text = 3,
+        major_array = 4,
+        major_map = 5
+    };
+}
+
+namespace c2ffi {
+    class CBOROutputDriver : public OutputDriver {
+        void head(unsigned major, uint64_t v) {
+            char b[9];
+            size_t n;
+
+            major <<= 5;
+
+            if (v < 24) {
+                b[0] = (char) (major | v);
+                n = 1;
+            } else if (v <= 0xff) {
+                b[0] = (char) (major | 24);
+                n = 2;
+            } else if (v <= 0xffff) {
+                b[0] = (char) (major | 25);
+                n = 3;
+            } else if (v <= 0xffffffffULL) {
+                b[0] = (char) (major | 26);
+                n = 5;
+            } else {
+                b[0] = (char) (major | 27);
+                n = 9;
+            }
+
+            for (size_t i = n - 1; i > 0; i--, v >>= 8)
+                b[i] = (char) (v & 0xff);
+
+            os().write(b, n);
+        }
+
+        void integer(int64_t v) {
+            if (v < 0)
+                head(major_negative, (uint64_t) (-1 - v));
+            else
+                head(major_unsigned, (uint64_t) v);
+        }
+
+        void text(llvm::StringRef s) {
+            head(major_text, s.size());
+            os() << s;
+        }
+
+        void boolean(bool b) { os().put(b ? '\xf5' : '\xf4'); }
+
+        void float64(double d) {
+            uint64_t bits;
+            char b[9];
+
+            memcpy(&bits, &d, sizeof(bits));
+            b[0] = '\xfb';
+            for (int i = 8; i > 0; i--, bits >>= 8)
+                b[i] = (char) (bits & 0xff);
+
+            os().write(b, sizeof(b));
+        }
+
+        void begin_array(size_t n) { head(major_array, n); }
+
+        void open(Tag tag) {
+            os().put('\xbf');
+            key(key_tag);
+            head(major_unsigned, tag);
+        }
+
+        void close() { os().put('\xff'); }
+
+        void key(Key k) { head(major_unsigned, k); }
+
+        void field(Key k, llvm::StringRef s) {
+            key(k);
+            text(s);
+        }
+
+        void field(Key k, uint64_t v) {
+            key(k);
+            head(major_unsigned, v);
+        }
+
+        void flag(Key k, bool b) {
+            key(k);
+            boolean(b);
+        }
+
+        // A constant's value: a number if it reads as one, text otherwise
+        void value(const VarDecl &d) {
+            const std::string &v = d.value();
+            const char *s = v.c_str();
+            char *end = nullptr;
+
+            key(key_value);
+
+            if (!d.is_string() && !v.empty()) {
+                errno = 0;
+                long long i = strtoll(s, &end, 10);
+
+                if (!errno && *end == '\0') {
+                    integer(i);
+                    return;
+                }
+
+                errno = 0;
+                unsigned long long u = strtoull(s, &end, 10);
+
+                if (!errno && *end == '\0' && v[0] != '-') {
+                    head(major_unsigned, u);
+                    return;
+                }
+
+                double f = strtod(s, &end);
+
+                if (*end == '\0') {
+                    float64(f);
+                    return;
+                }
+            }
+
+            text(v);
+        }
+
+        void write_identity(const Decl &d) {
+            if (!d.usr().empty())
+                field(key_usr, d.usr());
+
+            if (d.fingerprint())
+                field(key_fingerprint, d.fingerprint());
+        }
+
+        void write_location(const Decl &d) {
+            field(key_location, d.location());
+            write_identity(d);
+        }
+
+        void write_fields(const NameTypeVector &fields) {
+            begin_array(fields.size());
+
+            for (auto &f : fields) {
+                open(tag_field);
+                field(key_name, f.first);
+                field(key_bit_offset, f.second->bit_offset());
+                field(key_bit_size, f.second->bit_size());
+                field(key_bit_alignment, f.second->bit_alignment());
+                key(key_type);
+                write(*f.second);
+                close();
+            }
+        }
+
+        void write_template(const TemplateMixin &d) {
+            if (!d.is_template()) return;
+
+            key(key_template);
+            begin_array(d.args().size());
+
+            for (auto *arg : d.args()) {
+                open(tag_parameter);
+                key(key_type);
+                write(*arg->type());
+
+                if (arg->has_val())
+                    field(key_value, arg->val());
+
+                close();
+            }
+        }
+
+        void write_functions(const FunctionVector &funcs) {
+            begin_array(funcs.size());
+
+            for (auto *f : funcs)
+                write((const Writable &) *f);
+        }
+
+        void write_function_header(const FunctionDecl &d) {
+            open(tag_function);
+            field(key_name, d.name());
+            field(key_ns, d.ns());
+            write_location(d);
+            flag(key_variadic, d.is_variadic());
+            flag(key_inline, d.is_inline());
+            field(key_storage_class, d.storage_class());
+            write_template(d);
+        }
+
+        void write_function_tail(const FunctionDecl &d) {
+            const NameTypeVector &params = d.fields();
+
+            key(key_parameters);
+            begin_array(params.size());
+
+            for (auto &p : params) {
+                open(tag_parameter);
+                field(key_name, p.first);
+                key(key_type);
+                write(*p.second);
+                close();
+            }
+
+            key(key_return_type);
+            write(d.return_type());
+            close();
+        }
+
+        void write_type_decl(Tag tag, const TypeDecl &d) {
+            open(tag);
+            field(key_ns, d.ns());
+            field(key_name, d.name());
+            write_location(d);
+            key(key_type);
+            write(d.type());
+        }
+
+        void write_record(Tag tag, const RecordDecl &d) {
+            open(tag);
+            field(key_ns, d.ns());
+            field(key_name, d.name());
+            field(key_id, d.id());
+            write_location(d);
+            field(key_bit_size, d.bit_size());
+            field(key_bit_alignment, d.bit_alignment());
+        }
+
+        void write_named(Tag tag, const Decl &d) {
+            open(tag);
+            field(key_ns, d.ns());
+            field(key_name, d.name());
+            write_location(d);
+            close();
+        }
+
+    public:
+        explicit CBOROutputDriver(std::ostream *os)
+                : OutputDriver(os) {}
+
+        using OutputDriver::write;
+
+        void write_header() override {
+            os().put('\x9f');
+        }
+
+        void write_footer() override {
+            os().put('\xff');
+        }
+
+        void write_comment(const char *str) override {
+            open(tag_comment);
+            field(key_text, str);
+            close();
+        }
+
+        void write_namespace(const std::string &ns) override {
+            open(tag_namespace);
+            field(key_name, ns);
+            close();
+        }
+
+        void write_base(const std::string &path) override {
+            open(tag_base);
+            field(key_path, path);
+            close();
+        }
+
+        // Types -----------------------------------------------------------
+        void write(const SimpleType &t) override {
+            open(tag_simple);
+            field(key_name, t.name());
+
+            if (!t.usr().empty())
+                field(key_usr, t.usr());
+
+            close();
+        }
+
+        void write(const BasicType &t) override {
+            open(tag_basic);
+            field(key_name, t.name());
+            field(key_bit_size, t.bit_size());
+            field(key_bit_alignment, t.bit_alignment());
+            close();
+        }
+
+        void write(const BitfieldType &t) override {
+            open(tag_bitfield);
+            field(key_width, t.width());
+            key(key_type);
+            write(*t.base());
+            close();
+        }
+
+        void write(const PointerType &t) override {
+            open(tag_pointer);
+            key(key_type);
+            write(t.pointee());
+            close();
+        }
+
+        void write(const ReferenceType &t) override {
+            open(tag_reference);
+            key(key_type);
+            write(t.pointee());
+            close();
+        }
+
+        void write(const ArrayType &t) override {
+            open(tag_array);
+            key(key_type);
+            write(t.pointee());
+            field(key_size, t.size());
+            close();
+        }
+
+        void write(const RecordType &t) override {
+            open(t.is_union() ? tag_union_type :
+                 (t.is_class() ? tag_class_type : tag_struct_type));
+            field(key_name, t.name());
+            field(key_id, t.id());
+
+            if (!t.usr().empty())
+                field(key_usr, t.usr());
+
+            close();
+        }
+
+        void write(const EnumType &t) override {
+            open(tag_enum_type);
+            field(key_name, t.name());
+            field(key_id, t.id());
+
+            if (!t.usr().empty())
+                field(key_usr, t.usr());
+
+            close();
+        }
+
+        // Decls -----------------------------------------------------------
+        void write(const UnhandledDecl &d) override {
+            open(tag_unhandled);
+            field(key_name, d.name());
+            field(key_kind, d.kind());
+            write_location(d);
+            close();
+        }
+
+        void write(const VarDecl &d) override {
+            open(d.is_extern() ? tag_extern : tag_const);
+            field(key_name, d.name());
+            field(key_ns, d.ns());
+            write_location(d);
+            key(key_type);
+            write(d.type());
+
+            if (!d.value().empty())
+                value(d);
+
+            close();
+        }
+
+        void write(const FunctionDecl &d) override {
+            write_function_header(d);
+
+            if (d.is_objc_method())
+                field(key_scope, d.is_class_method() ? "class" : "instance");
+
+            write_function_tail(d);
+        }
+
+        void write(const CXXFunctionDecl &d) override {
+            write_function_header(d);
+            field(key_scope, d.is_static() ? "class" : "instance");
+            flag(key_virtual, d.is_virtual());
+            flag(key_pure, d.is_pure());
+            flag(key_const, d.is_const());
+            write_function_tail(d);
+        }
+
+        void write(const TypedefDecl &d) override {
+            write_type_decl(tag_typedef, d);
+            close();
+        }
+
+        void write(const RecordDecl &d) override {
+            write_record(d.is_union() ? tag_union : tag_struct, d);
+            key(key_fields);
+            write_fields(d.fields());
+            close();
+        }
+
+        void write(const CXXRecordDecl &d) override {
+            write_record(d.is_union() ? tag_union :
+                         (d.is_class() ? tag_class : tag_struct), d);
+            write_template(d);
+
+            key(key_parents);
+            begin_array(d.parents().size());
+
+            for (auto &p : d.parents()) {
+                open(tag_parent);
+                field(key_name, p.name);
+                key(key_offset);
+                integer(p.parent_offset);
+                flag(key_is_virtual, p.is_virtual);
+
+                switch (p.access) {
+                    case CXXRecordDecl::access_private:
+                        field(key_access, "private");
+                        break;
+                    case CXXRecordDecl::access_protected:
+                        field(key_access, "protected");
+                        break;
+                    case CXXRecordDecl::access_public:
+                        field(key_access, "public");
+                        break;
+                    default:
+                        field(key_access, "unknown");
+                }
+
+                close();
+            }
+
+            key(key_fields);
+            write_fields(d.fields());
+            key(key_methods);
+            write_functions(d.functions());
+            close();
+        }
+
+        void write(const CXXNamespaceDecl &d) override {
+            open(tag_namespace);
+            field(key_ns, d.ns());
+            field(key_name, d.name());
+            field(key_id, d.id());
+            write_identity(d);
+            close();
+        }
+
+        void write(const TypeAliasDecl &d) override {
+            write_type_decl(tag_type_alias, d);
+            close();
+        }
+
+        void write(const TypeAliasTemplateDecl &d) override {
+            write_type_decl(tag_type_alias_template, d);
+            write_template(d);
+            close();
+        }
+
+        void write(const VarTemplateDecl &d) override {
+            write_type_decl(tag_var_template, d);
+            write_template(d);
+            close();
+        }
+
+        void write(const UsingDecl &d) override {
+            write_named(tag_using, d);
+        }
+
+        void write(const UsingShadowDecl &d) override {
+            write_named(tag_using_shadow, d);
+        }
+
+        void write(const UsingDirectiveDecl &d) override {
+            write_named(tag_using_directive, d);
+        }
+
+        void write(const EnumDecl &d) override {
+            open(tag_enum);
+            field(key_ns, d.ns());
+            field(key_name, d.name());
+            field(key_id, d.id());
+            write_location(d);
+
+            key(key_fields);
+            begin_array(d.fields().size());
+
+            for (auto &f : d.fields()) {
+                open(tag_field);
+                field(key_name, f.first);
+                field(key_value, f.second);
+                close();
+            }
+
+            close();
+        }
+
+        void write(const ObjCInterfaceDecl &d) override {
+            open(d.is_forward() ? tag_objc_class : tag_objc_interface);
+            field(key_name, d.name());
+            write_location(d);
+            field(key_superclass, d.super());
+
+            key(key_protocols);
+            begin_array(d.protocols().size());
+            for (auto &p : d.protocols())
+                text(p);
+
+            key(key_ivars);
+            write_fields(d.fields());
+            key(key_methods);
+            write_functions(d.functions());
+            close();
+        }
+
+        void write(const ObjCCategoryDecl &d) override {
+            open(tag_objc_category);
+            field(key_name, d.name());
+            write_location(d);
+            field(key_category, d.category());
+            key(key_methods);
+            write_functions(d.functions());
+            close();
+        }
+
+        void write(const ObjCProtocolDecl &d) override {
+            open(tag_objc_protocol);
+            field(key_name, d.name());
+            write_location(d);
+            key(key_methods);
+            write_functions(d.functions());
+            close();
+        }
+
+        void write(const ForwardDecl &d) override {
+            open(tag_forward);
+            field(key_ns, d.ns());
+            field(key_name, d.name());
+            field(key_kind, d.kind());
+            field(key_id, d.id());
+            write_location(d);
+            close();
+        }
+
+        void write(const SourceFileDecl &d) override {
+            open(tag_file);
+            field(key_path, d.name());
+            field(key_hash, d.hash());
+            close();
+        }
+    };
+
+    OutputDriver *MakeCBOROutputDriver(std::ostream *os) {
+        return new CBOROutputDriver(os);
+    }
+}
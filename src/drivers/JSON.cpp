@@ -19,321 +19,554 @@
    along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include "c2ffi.h"
 
+#include <memory>
 #include <sstream>
-#include <cstdarg>
-#include <iomanip>
+#include <unordered_map>
+#include <vector>
+
+#include "c2ffi.h"
+#include "c2ffi/escape.h"
+#include "c2ffi/spec.h"
 
 using namespace c2ffi;
 
 namespace c2ffi {
     class JSONOutputDriver : public OutputDriver {
-        int _level;
+        // --index output, and what it needs to know about the
+        // declaration being written
+        std::unique_ptr<OutputSink> _index;
+        bool _top;
+        bool _raw;
+        std::string _top_tag;
+
+        // Where objects are written: os(), or a scratch buffer while a
+        // declaration or type is rendered for --type-table
+        OutputSink *_out;
+
+        struct Scratch {
+            std::ostringstream ss;
+            OutputSink sink;
+
+            Scratch() : sink(&ss) {}
+        };
+
+        // --type-table: each distinct type is written once, as a "type"
+        // object ahead of the first declaration using it, and referred
+        // to by id everywhere
+        bool _types;
+        std::vector<std::unique_ptr<Scratch>> _scratch;
+        size_t _depth;
+        std::unordered_map<std::string, uint64_t> _type_ids;
+
+        OutputSink &out() { return *_out; }
 
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wvarargs"
+        void begin_scratch() {
+            if (_depth == _scratch.size())
+                _scratch.emplace_back(new Scratch);
 
-        void write_object(const char *type, bool open, bool close, ...) {
-            va_list ap;
-            char *ptr = nullptr;
+            _out = &_scratch[_depth++]->sink;
+        }
+
+        // What was written since begin_scratch()
+        std::string end_scratch() {
+            Scratch &s = *_scratch[--_depth];
+
+            s.sink.flush();
+            std::string text = s.ss.str();
+            s.ss.str(std::string());
+
+            _out = _depth ? &_scratch[_depth - 1]->sink : &os();
+            return text;
+        }
+
+        void type(const Type &t) {
+            if (!_types) {
+                write(t);
+                return;
+            }
 
-            va_start(ap, close);
+            // Types inside this one are interned first, so the text is
+            // the same wherever it is used
+            begin_scratch();
+            write(t);
+            std::string text = end_scratch();
 
-            if (open) os() << R"({ "tag": ")" << type << "\"";
-            while ((ptr = va_arg(ap, char*))) {
-                os() << ", \"" << ptr << "\": ";
+            auto i = _type_ids.emplace(std::move(text), _type_ids.size() + 1);
 
-                if ((ptr = va_arg(ap, char*)))
-                    os() << ptr;
-                else
-                    break;
+            if (i.second) {
+                os() << R"({ "tag": "type", "id": )" << i.first->second
+                     << R"(, "type": )" << i.first->first << " }";
+                write_between();
             }
-            if (close) os() << " }";
 
-            va_end(ap);
+            out() << i.first->second;
         }
 
-#pragma clang diagnostic pop
+        // --file-table: locations are a number from the file table, a
+        // line and a column.  Each file is written once, as a "source"
+        // object ahead of the first declaration in it.
+        bool _files;
+        std::vector<bool> _files_written;
 
-        static std::string hex_str(unsigned char c) {
-            std::ostringstream ss;
-            ss.setf(std::ios::hex, std::ios::basefield);
-            ss << "\\u00" << std::setw(2) << std::setfill('0') << (int) c;
+        unsigned int file_id(const SourceFile &f) {
+            if (f.id >= _files_written.size())
+                _files_written.resize(f.id + 1);
+
+            if (!_files_written[f.id]) {
+                os() << R"({ "tag": "source", "id": )" << f.id << R"(, "path": )";
+                string(os(), f.path);
+                os() << " }";
+                write_between();
+
+                _files_written[f.id] = true;
+            }
 
-            return ss.str();
+            return f.id;
         }
 
-        static std::string escape_string(std::string s) {
-            for (int i = s.find('\\'); i != std::string::npos;
-                 i = s.find('\\', i + 2))
-                s.replace(i, 1, "\\\\");
+        // { "tag": "tag"
+        void open(llvm::StringRef tag) {
+            if (_top) {
+                _top_tag = tag.str();
+                _top = false;
+            }
+
+            out() << R"({ "tag": ")" << tag << '"';
+        }
+
+        void close() { out() << " }"; }
+
+        // , "name": and then the value
+        void key(const char *name) {
+            out() << ", \"" << name << "\": ";
+        }
+
+        // Backslash, quote and any byte outside printable ASCII
+        // escaped.  Runs which need no escaping are copied whole.
+        static void escape(OutputSink &out, llvm::StringRef s) {
+            static const char hex[] = "0123456789abcdef";
+            size_t start = 0;
+
+            for (;;) {
+                size_t i = start + json_escape_scan(s.data() + start,
+                                                    s.size() - start);
+
+                out << s.slice(start, i);
 
-            for (int i = s.find('\"'); i != std::string::npos;
-                 i = s.find('\"', i + 2))
-                s.replace(i, 1, "\\\"");
+                if (i == s.size()) break;
 
-            for (size_t i = 0; i < s.size(); i++)
-                if ((unsigned char) (s[i]) > 127 ||
-                    (unsigned char) (s[i]) < 32) {
-                    s.replace(i, 1, hex_str(s[i]));
-                    i += 5;
+                auto c = (unsigned char) s[i];
+
+                if (c == '\\' || c == '"') {
+                    out << '\\' << (char) c;
+                } else {
+                    char u[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+                    out.write(u, sizeof(u));
                 }
 
-            return s;
+                start = i + 1;
+            }
         }
 
-        template<typename T>
-        std::string str(T v) {
-            std::stringstream ss;
-            ss << v;
-            return ss.str();
+        static void string(OutputSink &out, llvm::StringRef s) {
+            out << '"';
+            escape(out, s);
+            out << '"';
+        }
+
+        void string(llvm::StringRef s) { string(out(), s); }
+
+        void field(const char *name, llvm::StringRef value) {
+            key(name);
+            string(value);
         }
 
         template<typename T>
-        std::string qstr(T v) {
-            std::stringstream ss;
-            ss << '"' << escape_string(v) << '"';
-            return ss.str();
+        void number(const char *name, T value) {
+            key(name);
+            out() << value;
+        }
+
+        void boolean(const char *name, bool value) {
+            key(name);
+            out() << (value ? "true" : "false");
+        }
+
+        // usr and fingerprint, when there are any
+        void write_identity(const Decl &d) {
+            if (!d.usr().empty())
+                field("usr", d.usr());
+
+            if (d.fingerprint()) {
+                static const char hex[] = "0123456789abcdef";
+                char fp[18];
+
+                fp[0] = fp[17] = '"';
+                for (int i = 0; i < 16; i++)
+                    fp[16 - i] = hex[(d.fingerprint() >> (i * 4)) & 15];
+
+                key("fingerprint");
+                out().write(fp, sizeof(fp));
+            }
+        }
+
+        void write_location(const Decl &d) {
+            if (_files) {
+                if (d.file()) {
+                    number("file", file_id(*d.file()));
+                    number("line", d.line());
+                    number("column", d.column());
+                }
+            } else {
+                key("location");
+                out() << '"';
+
+                if (!d.spelled_location().empty()) {
+                    escape(out(), d.spelled_location());
+                } else if (d.file()) {
+                    escape(out(), d.file()->path);
+                    out() << ':' << d.line() << ':' << d.column();
+                }
+
+                out() << '"';
+            }
+
+            write_identity(d);
+        }
+
+        void write_usr(const SimpleType &t) {
+            if (!t.usr().empty())
+                field("usr", t.usr());
         }
 
         void write_fields(const NameTypeVector &fields) {
-            os() << '[';
+            out() << '[';
             for (auto i = fields.begin();
                  i != fields.end(); i++) {
                 if (i != fields.begin())
-                    os() << ", ";
-
-                write_object("field", true, false,
-                             "name", qstr(i->first).c_str(),
-                             "bit-offset", str(i->second->bit_offset()).c_str(),
-                             "bit-size", str(i->second->bit_size()).c_str(),
-                             "bit-alignment", str(i->second->bit_alignment()).c_str(),
-                             "type", nullptr);
-                write(*(i->second));
-                write_object("", false, true, nullptr);
+                    out() << ", ";
+
+                open("field");
+                field("name", i->first);
+                number("bit-offset", i->second->bit_offset());
+                number("bit-size", i->second->bit_size());
+                number("bit-alignment", i->second->bit_alignment());
+                key("type");
+                type(*(i->second));
+                close();
             }
 
-            os() << ']';
+            out() << ']';
         }
 
         void write_template(const TemplateMixin &d) {
             if (d.is_template()) {
-                write_object("", false, false,
-                             "template", nullptr);
-                os() << "[";
+                key("template");
+                out() << "[";
                 for (auto i =
                         d.args().begin();
                      i != d.args().end(); ++i) {
                     if (i != d.args().begin())
-                        os() << ", ";
+                        out() << ", ";
 
-                    write_object("parameter", true, false,
-                                 "type", nullptr);
-                    write(*((*i)->type()));
+                    open("parameter");
+                    key("type");
+                    type(*((*i)->type()));
 
                     if ((*i)->has_val())
-                        write_object("", false, false,
-                                     "value", qstr((*i)->val()).c_str(),
-                                     nullptr);
+                        field("value", (*i)->val());
 
-                    write_object("", false, true, nullptr);
+                    close();
                 }
-                os() << "]";
+                out() << "]";
             }
         }
 
         void write_functions(const FunctionVector &funcs) {
-            os() << '[';
+            out() << '[';
             for (auto i = funcs.begin();
                  i != funcs.end(); i++) {
                 if (i != funcs.begin())
-                    os() << ", ";
+                    out() << ", ";
                 write((const Writable &) *(*i));
             }
-            os() << ']';
+            out() << ']';
         }
 
         void write_function_header(const FunctionDecl &d) {
-            const char *variadic = d.is_variadic() ? "true" : "false";
-            const char *inline_ = d.is_inline() ? "true" : "false";
-
-            write_object("function", true, false,
-                         "name", qstr(d.name()).c_str(),
-                         "ns", str(d.ns()).c_str(),
-                         "location", qstr(d.location()).c_str(),
-                         "variadic", variadic,
-                         "inline", inline_,
-                         "storage-class", qstr(d.storage_class()).c_str(),
-                         nullptr);
+            open("function");
+            field("name", d.name());
+            number("ns", d.ns());
+            write_location(d);
+            boolean("variadic", d.is_variadic());
+            boolean("inline", d.is_inline());
+            field("storage-class", d.storage_class());
             write_template(d);
         }
 
         void write_function_params(const FunctionDecl &d) {
-            write_object("", false, false, "parameters", nullptr);
-            os() << "[";
+            key("parameters");
+            out() << "[";
             const NameTypeVector &params = d.fields();
             for (auto i = params.begin();
                  i != params.end(); i++) {
                 if (i != params.begin())
-                    os() << ", ";
+                    out() << ", ";
 
-                write_object("parameter", true, false,
-                             "name", qstr((*i).first).c_str(),
-                             "type", nullptr);
-                write(*(*i).second);
-                write_object("", false, true, nullptr);
+                open("parameter");
+                field("name", (*i).first);
+                key("type");
+                type(*(*i).second);
+                close();
             }
 
-            os() << "]";
+            out() << "]";
         }
 
         void write_function_return(const FunctionDecl &d) {
-            write_object("", false, false,
-                         "return-type", nullptr);
-            write(d.return_type());
-            write_object("", false, true, nullptr);
+            key("return-type");
+            type(d.return_type());
+            close();
+        }
+
+        static bool is_quoted_value(const VarDecl &d) {
+            return d.is_string()
+                   || d.value() == "inf"
+                   || d.value() == "INF"
+                   || d.value() == "Inf"
+                   || d.value() == "nan"
+                   || d.value() == "NaN";
+        }
+
+        // "path:line:col" to "path"
+        static llvm::StringRef location_file(llvm::StringRef loc) {
+            return loc.rsplit(':').first.rsplit(':').first;
+        }
+
+        // One line per top-level object:
+        //   { "offset": N, "length": N, "tag": T, "name": N, "file": F }
+        void write_index(const Decl &d, uint64_t start) {
+            OutputSink &out = *_index;
+
+            out << R"({ "offset": )" << start
+                << R"(, "length": )" << (os().tell() - start)
+                << R"(, "tag": ")";
+
+            if (_raw) {
+                // Already escaped
+                llvm::StringRef text = static_cast<const RawDecl &>(d).text();
+                llvm::StringRef tag = spec_tag(text);
+
+                out << tag << R"(", "name": ")"
+                    << spec_string(text, tag == "file" ? "path" : "name")
+                    << R"(", "file": ")"
+                    << location_file(spec_string(text, "location")) << '"';
+            } else {
+                out << _top_tag << R"(", "name": )";
+                string(out, d.name());
+                out << R"(, "file": )";
+                string(out, d.file() ? llvm::StringRef(d.file()->path)
+                                     : llvm::StringRef());
+            }
+
+            out << " }\n";
         }
 
+    protected:
+        void flush_index() {
+            if (_index) _index->flush();
+        }
 
     public:
         explicit JSONOutputDriver(std::ostream *os)
-                : OutputDriver(os), _level(0) {}
+                : OutputDriver(os), _top(false), _raw(false),
+                  _out(&this->os()), _types(false), _depth(0),
+                  _files(false) {}
+
+        bool set_index(std::ostream *index) override {
+            _index.reset(new OutputSink(index));
+            return true;
+        }
+
+        bool set_type_table() override {
+            _types = true;
+            return true;
+        }
+
+        bool set_file_table() override {
+            _files = true;
+            return true;
+        }
+
+        void write_decl(const Decl &d) override {
+            if (!_index && !_types && !_files) {
+                write(d);
+                return;
+            }
+
+            uint64_t start;
+
+            _top = true;
+            _raw = false;
+
+            if (_types || _files) {
+                // Types and files it uses for the first time go out
+                // ahead of it
+                begin_scratch();
+                write(d);
+                std::string text = end_scratch();
+
+                start = os().tell();
+                os() << text;
+            } else {
+                start = os().tell();
+                write(d);
+            }
+
+            _top = false;
+
+            if (_index)
+                write_index(d, start);
+        }
 
         using OutputDriver::write;
 
         void write_header() override {
-            os() << "[" << std::endl;
+            os() << "[\n";
         }
 
         void write_between() override {
-            os() << "," << std::endl;
+            os() << ",\n";
         }
 
         void write_footer() override {
-            os() << "\n]" << std::endl;
+            os() << "\n]\n";
+            flush_index();
         }
 
         void write_comment(const char *str) override {
-            write_object("comment", true, true,
-                         "text", qstr(str).c_str(),
-                         nullptr);
+            open("comment");
+            field("text", str);
+            close();
         }
 
         void write_namespace(const std::string &ns) override {
-            write_object("namespace", true, true,
-                         "name", qstr(ns).c_str(),
-                         nullptr);
+            open("namespace");
+            field("name", ns);
+            close();
+            write_between();
+        }
+
+        void write_base(const std::string &path) override {
+            open("base");
+            field("path", path);
+            close();
             write_between();
         }
 
         // Types -----------------------------------------------------------
         void write(const SimpleType &t) override {
-            write_object(t.name().c_str(), true, true, nullptr);
+            open(t.name());
+            write_usr(t);
+            close();
         }
 
         void write(const BasicType &t) override {
-            write_object(t.name().c_str(), true, true,
-                         "bit-size", str(t.bit_size()).c_str(),
-                         "bit-alignment", str(t.bit_alignment()).c_str(),
-                         nullptr);
+            open(t.name());
+            number("bit-size", t.bit_size());
+            number("bit-alignment", t.bit_alignment());
+            close();
         }
 
         void write(const BitfieldType &t) override {
-            write_object(":bitfield", true, false,
-                         "width", str(t.width()).c_str(),
-                         "type", nullptr);
-            write(*t.base());
-            write_object("", false, true, nullptr);
+            open(":bitfield");
+            number("width", t.width());
+            key("type");
+            type(*t.base());
+            close();
         }
 
         void write(const PointerType &t) override {
-            write_object(":pointer", true, false,
-                         "type", nullptr);
-            write(t.pointee());
-            write_object("", false, true, nullptr);
+            open(":pointer");
+            key("type");
+            type(t.pointee());
+            close();
         }
 
         void write(const ReferenceType &t) override {
-            write_object(":reference", true, false,
-                         "type", nullptr);
-            write(t.pointee());
-            write_object("", false, true, nullptr);
+            open(":reference");
+            key("type");
+            type(t.pointee());
+            close();
         }
 
         void write(const ArrayType &t) override {
-            write_object(":array", true, false,
-                         "type", nullptr);
-            write(t.pointee());
-            write_object("", false, true,
-                         "size", str(t.size()).c_str(),
-                         nullptr);
+            open(":array");
+            key("type");
+            type(t.pointee());
+            number("size", t.size());
+            close();
         }
 
         void write(const RecordType &t) override {
-            const char *type = nullptr;
-
             if (t.is_union())
-                type = ":union";
+                open(":union");
             else if (t.is_class())
-                type = ":class";
+                open(":class");
             else
-                type = ":struct";
+                open(":struct");
 
-            write_object(type, true, true,
-                         "name", qstr(t.name()).c_str(),
-                         "id", str(t.id()).c_str(),
-                         nullptr);
+            field("name", t.name());
+            number("id", t.id());
+            write_usr(t);
+            close();
         }
 
         void write(const EnumType &t) override {
-            write_object(":enum", true, true,
-                         "name", qstr(t.name()).c_str(),
-                         "id", str(t.id()).c_str(),
-                         nullptr);
+            open(":enum");
+            field("name", t.name());
+            number("id", t.id());
+            write_usr(t);
+            close();
         }
 
         // Decls -----------------------------------------------------------
         void write(const UnhandledDecl &d) override {
-            write_object("unhandled", true, true,
-                         "name", qstr(d.name()).c_str(),
-                         "kind", qstr(d.kind()).c_str(),
-                         "location", qstr(d.location()).c_str(),
-                         nullptr);
+            open("unhandled");
+            field("name", d.name());
+            field("kind", d.kind());
+            write_location(d);
+            close();
         }
 
         void write(const VarDecl &d) override {
-            const char *type = d.is_extern() ? "extern" : "const";
-
-            write_object(type, true, false,
-                         "name", qstr(d.name()).c_str(),
-                         "ns", str(d.ns()).c_str(),
-                         "location", qstr(d.location()).c_str(),
-                         "type", nullptr);
-
-            write(d.type());
+            open(d.is_extern() ? "extern" : "const");
+            field("name", d.name());
+            number("ns", d.ns());
+            write_location(d);
+            key("type");
+            type(d.type());
 
             if (!d.value().empty()) {
-                write_object("", false, false,
-                             "value", (d.is_string()
-                                       || d.value() == "inf"
-                                       || d.value() == "INF"
-                                       || d.value() == "Inf"
-                                       || d.value() == "nan"
-                                       || d.value() == "NaN" ? qstr(d.value()) : str(d.value())).c_str(),
-                             nullptr);
+                if (is_quoted_value(d)) {
+                    field("value", d.value());
+                } else {
+                    key("value");
+                    out() << d.value();
+                }
             }
 
-            write_object("", false, true, nullptr);
+            close();
         }
 
         void write(const FunctionDecl &d) override {
             write_function_header(d);
 
-            if (d.is_objc_method())
-                write_object("", false, false,
-                             "scope", d.is_class_method() ? "\"class\"" : "\"instance\"",
-                             nullptr);
+            if (d.is_objc_method()) {
+                key("scope");
+                out() << (d.is_class_method() ? "\"class\"" : "\"instance\"");
+            }
 
             write_function_params(d);
             write_function_return(d);
@@ -342,250 +575,301 @@ namespace c2ffi {
         void write(const CXXFunctionDecl &d) override {
             write_function_header(d);
 
-            write_object("", false, false,
-                         "scope", d.is_static() ? "\"class\"" : "\"instance\"",
-                         "virtual", d.is_virtual() ? "true" : "false",
-                         "pure", d.is_pure() ? "true" : "false",
-                         "const", d.is_const() ? "true" : "false",
-                         nullptr);
+            key("scope");
+            out() << (d.is_static() ? "\"class\"" : "\"instance\"");
+            boolean("virtual", d.is_virtual());
+            boolean("pure", d.is_pure());
+            boolean("const", d.is_const());
 
             write_function_params(d);
             write_function_return(d);
         }
 
         void write(const TypedefDecl &d) override {
-            write_object("typedef", true, false,
-                         "ns", str(d.ns()).c_str(),
-                         "name", qstr(d.name()).c_str(),
-                         "location", qstr(d.location()).c_str(),
-                         "type", nullptr);
-
-            write(d.type());
-            write_object("", false, true, nullptr);
+            open("typedef");
+            number("ns", d.ns());
+            field("name", d.name());
+            write_location(d);
+            key("type");
+            type(d.type());
+            close();
         }
 
         void write(const RecordDecl &d) override {
-            const char *type = d.is_union() ? "union" : "struct";
-
-            write_object(type, true, false,
-                         "ns", str(d.ns()).c_str(),
-                         "name", qstr(d.name()).c_str(),
-                         "id", str(d.id()).c_str(),
-                         "location", qstr(d.location()).c_str(),
-                         "bit-size", str(d.bit_size()).c_str(),
-                         "bit-alignment", str(d.bit_alignment()).c_str(),
-                         "fields", nullptr);
-
+            open(d.is_union() ? "union" : "struct");
+            number("ns", d.ns());
+            field("name", d.name());
+            number("id", d.id());
+            write_location(d);
+            number("bit-size", d.bit_size());
+            number("bit-alignment", d.bit_alignment());
+            key("fields");
             write_fields(d.fields());
-            write_object("", false, true, nullptr);
+            close();
         }
 
         void write(const CXXRecordDecl &d) override {
-            const char *type = d.is_union() ? "union" :
-                               (d.is_class() ? "class" : "struct");
-
-            write_object(type, true, false,
-                         "ns", str(d.ns()).c_str(),
-                         "name", qstr(d.name()).c_str(),
-                         "id", str(d.id()).c_str(),
-                         "location", qstr(d.location()).c_str(),
-                         "bit-size", str(d.bit_size()).c_str(),
-                         "bit-alignment", str(d.bit_alignment()).c_str(),
-                         nullptr);
+            open(d.is_union() ? "union" :
+                 (d.is_class() ? "class" : "struct"));
+            number("ns", d.ns());
+            field("name", d.name());
+            number("id", d.id());
+            write_location(d);
+            number("bit-size", d.bit_size());
+            number("bit-alignment", d.bit_alignment());
 
             write_template(d);
 
-            write_object("", false, false,
-                         "parents", nullptr);
-
-            os() << "[";
+            key("parents");
+            out() << "[";
 
             const CXXRecordDecl::ParentRecordVector &parents = d.parents();
             for (auto i
                     = parents.begin();
                  i != parents.end(); ++i) {
                 if (i != parents.begin())
-                    os() << ", ";
+                    out() << ", ";
 
-                write_object("class", true, false,
-                             "name", qstr((*i).name).c_str(),
-                             "offset", str((*i).parent_offset).c_str(),
-                             "is_virtual", ((*i).is_virtual ? "true" : "false"),
-                             "access", nullptr);
+                open("class");
+                field("name", (*i).name);
+                number("offset", (*i).parent_offset);
+                boolean("is_virtual", (*i).is_virtual);
+                key("access");
 
                 switch ((*i).access) {
                     case CXXRecordDecl::access_private:
-                        os() << "\"private\"";
+                        out() << "\"private\"";
                         break;
                     case CXXRecordDecl::access_protected:
-                        os() << "\"protected\"";
+                        out() << "\"protected\"";
                         break;
                     case CXXRecordDecl::access_public:
-                        os() << "\"public\"";
+                        out() << "\"public\"";
                         break;
                     default:
-                        os() << "\"unknown\"";
+                        out() << "\"unknown\"";
                 }
 
-                write_object("", false, true, nullptr);
+                close();
             }
 
-            os() << "]";
-
-            write_object("", false, false,
-                         "fields", nullptr);
+            out() << "]";
 
+            key("fields");
             write_fields(d.fields());
-            write_object("", false, false,
-                         "methods", nullptr);
+            key("methods");
             write_functions(d.functions());
-            write_object("", false, true, nullptr);
+            close();
         }
 
         void write(const CXXNamespaceDecl &d) override {
-            write_object("namespace", true, true,
-                         "ns", str(d.ns()).c_str(),
-                         "name", qstr(d.name()).c_str(),
-                         "id", str(d.id()).c_str(),
-                         nullptr);
+            open("namespace");
+            number("ns", d.ns());
+            field("name", d.name());
+            number("id", d.id());
+            write_identity(d);
+            close();
         }
 
         void write(const TypeAliasDecl &d) override {
-            write_object("type-alias", true, false,
-                         "ns", str(d.ns()).c_str(),
-                         "name", qstr(d.name()).c_str(),
-                         "location", qstr(d.location()).c_str(),
-                         "type",
-                         nullptr);
-            write(d.type());
-            write_object("", false, true, nullptr);
+            open("type-alias");
+            number("ns", d.ns());
+            field("name", d.name());
+            write_location(d);
+            key("type");
+            type(d.type());
+            close();
         }
 
         void write(const TypeAliasTemplateDecl &d) override {
-            write_object("type-alias-template", true, false,
-                         "ns", str(d.ns()).c_str(),
-                         "name", qstr(d.name()).c_str(),
-                         "location", qstr(d.location()).c_str(),
-                         "type",
-                         nullptr);
-
-            write(d.type());
+            open("type-alias-template");
+            number("ns", d.ns());
+            field("name", d.name());
+            write_location(d);
+            key("type");
+            type(d.type());
             write_template(d);
-            write_object("", false, true, nullptr);
+            close();
         }
 
         void write(const VarTemplateDecl &d) override {
-            write_object("var-template", true, false,
-                         "ns", str(d.ns()).c_str(),
-                         "name", qstr(d.name()).c_str(),
-                         "location", qstr(d.location()).c_str(),
-                         "type",
-                         nullptr);
-            write(d.type());
+            open("var-template");
+            number("ns", d.ns());
+            field("name", d.name());
+            write_location(d);
+            key("type");
+            type(d.type());
             write_template(d);
-            write_object("", false, true, nullptr);
+            close();
         }
 
         void write(const UsingDecl &d) override {
-            write_object("using", true, false,
-                         "ns", str(d.ns()).c_str(),
-                         "name", qstr(d.name()).c_str(),
-                         "location", qstr(d.location()).c_str(),
-                         nullptr);
-            write_object("", false, true, nullptr);
+            open("using");
+            number("ns", d.ns());
+            field("name", d.name());
+            write_location(d);
+            close();
         }
 
         void write(const UsingShadowDecl &d) override {
-            write_object("using-shadow", true, false,
-                         "ns", str(d.ns()).c_str(),
-                         "name", qstr(d.name()).c_str(),
-                         "location", qstr(d.location()).c_str(),
-                         nullptr);
-            write_object("", false, true, nullptr);
+            open("using-shadow");
+            number("ns", d.ns());
+            field("name", d.name());
+            write_location(d);
+            close();
         }
 
         void write(const UsingDirectiveDecl &d) override {
-            write_object("using-directive", true, true,
-                         "ns", str(d.ns()).c_str(),
-                         "name", qstr(d.name()).c_str(),
-                         "location", qstr(d.location()).c_str(),
-                         nullptr);
+            open("using-directive");
+            number("ns", d.ns());
+            field("name", d.name());
+            write_location(d);
+            close();
         }
 
         void write(const EnumDecl &d) override {
-            write_object("enum", true, false,
-                         "ns", str(d.ns()).c_str(),
-                         "name", qstr(d.name()).c_str(),
-                         "id", str(d.id()).c_str(),
-                         "location", qstr(d.location()).c_str(),
-                         "fields", nullptr);
-
-            os() << "[";
+            open("enum");
+            number("ns", d.ns());
+            field("name", d.name());
+            number("id", d.id());
+            write_location(d);
+            key("fields");
+
+            out() << "[";
             const NameNumVector &fields = d.fields();
             for (auto i = fields.begin();
                  i != fields.end(); ++i) {
                 if (i != fields.begin())
-                    os() << ", ";
+                    out() << ", ";
 
-                write_object("field", true, true,
-                             "name", qstr(i->first).c_str(),
-                             "value", str(i->second).c_str(),
-                             nullptr);
+                open("field");
+                field("name", i->first);
+                number("value", i->second);
+                close();
             }
 
-            os() << "]";
-            write_object("", false, true, nullptr);
+            out() << "]";
+            close();
         }
 
         void write(const ObjCInterfaceDecl &d) override {
-            write_object(d.is_forward() ? "@class" : "@interface", true, false,
-                         "name", qstr(d.name()).c_str(),
-                         "location", qstr(d.location()).c_str(),
-                         "superclass", qstr(d.super()).c_str(),
-                         "protocols", nullptr);
+            open(d.is_forward() ? "@class" : "@interface");
+            field("name", d.name());
+            write_location(d);
+            field("superclass", d.super());
+            key("protocols");
 
-            os() << "[";
+            out() << "[";
             const NameVector &protocols = d.protocols();
             for (auto i = protocols.begin();
                  i != protocols.end(); i++) {
                 if (i != protocols.begin())
-                    os() << ", ";
-                os() << qstr(*i).c_str();
+                    out() << ", ";
+                string(*i);
             }
-            os() << "]";
+            out() << "]";
 
-            write_object("", false, false,
-                         "ivars", nullptr);
+            key("ivars");
             write_fields(d.fields());
 
-            write_object("", false, false,
-                         "methods", nullptr);
+            key("methods");
             write_functions(d.functions());
 
-            write_object("", false, true, nullptr);
+            close();
         }
 
         void write(const ObjCCategoryDecl &d) override {
-            write_object("@category", true, false,
-                         "name", qstr(d.name()).c_str(),
-                         "location", qstr(d.location()).c_str(),
-                         "category", qstr(d.category()).c_str(),
-                         "methods", nullptr);
+            open("@category");
+            field("name", d.name());
+            write_location(d);
+            field("category", d.category());
+            key("methods");
             write_functions(d.functions());
-            write_object("", false, true, nullptr);
+            close();
         }
 
         void write(const ObjCProtocolDecl &d) override {
-            write_object("@protocol", true, false,
-                         "name", qstr(d.name()).c_str(),
-                         "location", qstr(d.location()).c_str(),
-                         "methods", nullptr);
+            open("@protocol");
+            field("name", d.name());
+            write_location(d);
+            key("methods");
             write_functions(d.functions());
-            write_object("", false, true, nullptr);
+            close();
+        }
+
+        void write(const SourceFileDecl &d) override {
+            open("file");
+            field("path", d.name());
+            field("hash", d.hash());
+            field("key", d.key());
+            key("ids");
+
+            out() << "[";
+            for (auto i = d.ids().begin(); i != d.ids().end(); ++i) {
+                if (i != d.ids().begin())
+                    out() << ", ";
+
+                out() << "[" << i->first << ", ";
+                string(i->second);
+                out() << "]";
+            }
+            out() << "]";
+
+            close();
+        }
+
+        void write(const ForwardDecl &d) override {
+            open("forward");
+            number("ns", d.ns());
+            field("name", d.name());
+            field("kind", d.kind());
+            number("id", d.id());
+            write_location(d);
+            close();
+        }
+
+        void write(const RawDecl &d) override {
+            if (_top) {
+                _raw = true;
+                _top = false;
+            }
+
+            out() << d.text();
+        }
+    };
+
+    /* The same objects, one per line and not wrapped in an array, so
+       output can be read a line at a time. */
+    class NDJSONOutputDriver : public JSONOutputDriver {
+        // Where the last line ended
+        uint64_t _line_end;
+
+        void end_line() {
+            os() << '\n';
+            _line_end = os().tell();
+        }
+
+    public:
+        explicit NDJSONOutputDriver(std::ostream *os)
+                : JSONOutputDriver(os), _line_end(0) {}
+
+        void write_header() override {}
+
+        void write_between() override { end_line(); }
+
+        void write_footer() override {
+            if (os().tell() != _line_end)
+                end_line();
+
+            flush_index();
         }
     };
 
     OutputDriver *MakeJSONOutputDriver(std::ostream *os) {
         return new JSONOutputDriver(os);
     }
+
+    OutputDriver *MakeNDJSONOutputDriver(std::ostream *os) {
+        return new NDJSONOutputDriver(os);
+    }
 }
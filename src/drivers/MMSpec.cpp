@@ -0,0 +1,447 @@
+/* -*- c++ -*-
+
+   c2ffi
+   Copyright (C) 2013  Ryan Pavlik
+
+   This file is part of c2ffi.
+
+   c2ffi is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   c2ffi is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "c2ffi.h"
+#include "c2ffi/mmspec.h"
+
+using namespace c2ffi;
+
+static_assert(sizeof(c2ffi_mm_header) == 80, "mmspec header layout");
+static_assert(sizeof(c2ffi_mm_decl) == 56, "mmspec decl layout");
+static_assert(sizeof(c2ffi_mm_type) == 40, "mmspec type layout");
+static_assert(sizeof(c2ffi_mm_field) == 32, "mmspec field layout");
+
+namespace c2ffi {
+    /* Collects everything and writes the file in write_footer(), as the
+       string table and name index need the whole output.  C++ methods,
+       templates and base classes, and ObjC methods are not included;
+       those declarations are written with their name and fields only. */
+    class MMSpecOutputDriver : public OutputDriver {
+        std::vector<c2ffi_mm_decl> _decls;
+        std::vector<c2ffi_mm_type> _types;
+        std::vector<c2ffi_mm_field> _fields;
+
+        // Declarations which go in the name index
+        std::vector<uint32_t> _named;
+
+        std::string _strings;
+        std::map<std::string, uint32_t> _string_index;
+        std::map<std::string, uint32_t> _type_index;
+
+        // Set by each write(Type)
+        uint32_t _last_type;
+
+        // Nonzero while writing a type: declarations written then are
+        // inline ones, such as an anonymous struct in a typedef
+        unsigned _type_depth;
+
+        uint32_t str(const std::string &s) {
+            auto it = _string_index.find(s);
+
+            if (it != _string_index.end())
+                return it->second;
+
+            auto off = (uint32_t) _strings.size();
+
+            _strings.append(s);
+            _strings.push_back('\0');
+            _string_index[s] = off;
+
+            return off;
+        }
+
+        // Identical types share one record
+        void intern(c2ffi_mm_type t) {
+            std::string key((const char *) &t, sizeof(t));
+            auto it = _type_index.find(key);
+
+            if (it != _type_index.end()) {
+                _last_type = it->second;
+                return;
+            }
+
+            _last_type = (uint32_t) _types.size();
+            _types.push_back(t);
+            _type_index[key] = _last_type;
+        }
+
+        static c2ffi_mm_type new_type(uint32_t kind) {
+            c2ffi_mm_type t;
+
+            memset(&t, 0, sizeof(t));
+            t.kind = kind;
+            t.target = C2FFI_MM_NONE;
+
+            return t;
+        }
+
+        uint32_t type(const Type &t) {
+            _type_depth++;
+            write(t);
+            _type_depth--;
+
+            return _last_type;
+        }
+
+        // Returns the index of the new declaration record
+        uint32_t begin_decl(uint32_t kind, const Decl &d) {
+            c2ffi_mm_decl r;
+            auto index = (uint32_t) _decls.size();
+
+            memset(&r, 0, sizeof(r));
+            r.kind = kind;
+            r.name = str(d.name());
+            r.location = str(d.location());
+            r.ns = d.ns();
+            r.id = d.id();
+            r.type = C2FFI_MM_NONE;
+
+            if (!_type_depth && !d.name().empty())
+                _named.push_back(index);
+
+            _decls.push_back(r);
+            return index;
+        }
+
+        // A declaration written as a type stands for that type
+        void end_decl(uint32_t index) {
+            if (_type_depth) {
+                c2ffi_mm_type t = new_type(C2FFI_MM_T_DECL);
+                t.target = index;
+                intern(t);
+            }
+        }
+
+        /* Field types may add inline declarations, with fields of their
+           own, so fields are collected first and then added in one run. */
+        void add_fields(uint32_t decl, const NameTypeVector &fields) {
+            std::vector<c2ffi_mm_field> v;
+
+            for (auto &f : fields) {
+                c2ffi_mm_field r;
+
+                memset(&r, 0, sizeof(r));
+                r.name = str(f.first);
+                r.type = type(*f.second);
+                r.bit_offset = f.second->bit_offset();
+                r.bit_size = f.second->bit_size();
+                r.bit_alignment = (uint32_t) f.second->bit_alignment();
+                v.push_back(r);
+            }
+
+            _decls[decl].first_field = (uint32_t) _fields.size();
+            _decls[decl].field_count = (uint32_t) v.size();
+            _fields.insert(_fields.end(), v.begin(), v.end());
+        }
+
+        uint32_t write_record(uint32_t kind, const RecordDecl &d) {
+            uint32_t i = begin_decl(kind, d);
+
+            _decls[i].bit_size = d.bit_size();
+            _decls[i].bit_alignment = (uint32_t) d.bit_alignment();
+            add_fields(i, d.fields());
+
+            return i;
+        }
+
+        uint32_t write_typed(uint32_t kind, const TypeDecl &d) {
+            uint32_t i = begin_decl(kind, d);
+            uint32_t t = type(d.type());
+
+            _decls[i].type = t;
+            return i;
+        }
+
+        void write_named(uint32_t kind, const Decl &d) {
+            end_decl(begin_decl(kind, d));
+        }
+
+        uint32_t write_var(const VarDecl &d) {
+            uint32_t i = write_typed(d.is_extern() ? C2FFI_MM_EXTERN : C2FFI_MM_CONST, d);
+
+            _decls[i].value = str(d.value());
+            if (d.is_string()) _decls[i].flags |= C2FFI_MM_STRING_VALUE;
+            return i;
+        }
+
+        // The kind of what a ForwardDecl declares
+        static uint32_t forward_kind(const std::string &kind) {
+            if (kind == "struct") return C2FFI_MM_STRUCT;
+            if (kind == "union") return C2FFI_MM_UNION;
+            if (kind == "class") return C2FFI_MM_CLASS;
+            if (kind == "enum") return C2FFI_MM_ENUM;
+            if (kind == "typedef") return C2FFI_MM_TYPEDEF;
+            if (kind == "function") return C2FFI_MM_FUNCTION;
+
+            return C2FFI_MM_UNHANDLED;
+        }
+
+        template<typename T>
+        void pad_to(T &out, uint64_t &pos) {
+            static const char zeros[8] = {0};
+            size_t n = (size_t) ((8 - pos % 8) % 8);
+
+            out.write(zeros, n);
+            pos += n;
+        }
+
+        template<typename T>
+        void section(const std::vector<T> &v, uint64_t &pos) {
+            os().write((const char *) v.data(), v.size() * sizeof(T));
+            pos += v.size() * sizeof(T);
+            pad_to(os(), pos);
+        }
+
+    public:
+        explicit MMSpecOutputDriver(std::ostream *os)
+                : OutputDriver(os), _last_type(C2FFI_MM_NONE), _type_depth(0) {
+            str("");
+        }
+
+        using OutputDriver::write;
+
+        void write_footer() override {
+            // Half full at most, so probes stay short
+            uint32_t bucket_count = 1;
+            while (bucket_count < _named.size() * 2) bucket_count <<= 1;
+
+            std::vector<uint32_t> buckets(bucket_count, C2FFI_MM_NONE);
+
+            for (uint32_t d : _named) {
+                const char *name = _strings.c_str() + _decls[d].name;
+                uint32_t i = c2ffi_mm_hash(name, strlen(name)) & (bucket_count - 1);
+
+                while (buckets[i] != C2FFI_MM_NONE)
+                    i = (i + 1) & (bucket_count - 1);
+
+                buckets[i] = d;
+            }
+
+            c2ffi_mm_header h;
+            uint64_t pos = sizeof(h);
+
+            memset(&h, 0, sizeof(h));
+            memcpy(h.magic, C2FFI_MM_MAGIC, sizeof(C2FFI_MM_MAGIC));
+            h.version = C2FFI_MM_VERSION;
+            h.byte_order = C2FFI_MM_BYTE_ORDER;
+            h.decl_count = (uint32_t) _decls.size();
+            h.type_count = (uint32_t) _types.size();
+            h.field_count = (uint32_t) _fields.size();
+            h.bucket_count = bucket_count;
+
+            h.decls = pos;
+            pos += (_decls.size() * sizeof(c2ffi_mm_decl) + 7) / 8 * 8;
+            h.types = pos;
+            pos += (_types.size() * sizeof(c2ffi_mm_type) + 7) / 8 * 8;
+            h.fields = pos;
+            pos += (_fields.size() * sizeof(c2ffi_mm_field) + 7) / 8 * 8;
+            h.buckets = pos;
+            pos += (buckets.size() * sizeof(uint32_t) + 7) / 8 * 8;
+            h.strings = pos;
+            h.strings_size = _strings.size();
+
+            pos = 0;
+            os().write((const char *) &h, sizeof(h));
+            pos += sizeof(h);
+            section(_decls, pos);
+            section(_types, pos);
+            section(_fields, pos);
+            section(buckets, pos);
+            os() << _strings;
+        }
+
+        // Types -----------------------------------------------------------
+        void write(const SimpleType &t) override {
+            c2ffi_mm_type r = new_type(C2FFI_MM_T_SIMPLE);
+            r.name = str(t.name());
+            intern(r);
+        }
+
+        void write(const BasicType &t) override {
+            c2ffi_mm_type r = new_type(C2FFI_MM_T_BASIC);
+            r.name = str(t.name());
+            r.bit_size = t.bit_size();
+            r.bit_alignment = (uint32_t) t.bit_alignment();
+            intern(r);
+        }
+
+        void write(const BitfieldType &t) override {
+            c2ffi_mm_type r = new_type(C2FFI_MM_T_BITFIELD);
+            r.target = type(*t.base());
+            r.size = t.width();
+            intern(r);
+        }
+
+        void write(const PointerType &t) override {
+            c2ffi_mm_type r = new_type(C2FFI_MM_T_POINTER);
+            r.target = type(t.pointee());
+            intern(r);
+        }
+
+        void write(const ReferenceType &t) override {
+            c2ffi_mm_type r = new_type(C2FFI_MM_T_REFERENCE);
+            r.target = type(t.pointee());
+            intern(r);
+        }
+
+        void write(const ArrayType &t) override {
+            c2ffi_mm_type r = new_type(C2FFI_MM_T_ARRAY);
+            r.target = type(t.pointee());
+            r.size = t.size();
+            intern(r);
+        }
+
+        void write(const RecordType &t) override {
+            c2ffi_mm_type r = new_type(t.is_union() ? C2FFI_MM_T_UNION :
+                                       (t.is_class() ? C2FFI_MM_T_CLASS : C2FFI_MM_T_STRUCT));
+            r.name = str(t.name());
+            r.id = t.id();
+            intern(r);
+        }
+
+        void write(const EnumType &t) override {
+            c2ffi_mm_type r = new_type(C2FFI_MM_T_ENUM);
+            r.name = str(t.name());
+            r.id = t.id();
+            intern(r);
+        }
+
+        // Decls -----------------------------------------------------------
+        void write(const UnhandledDecl &d) override {
+            write_named(C2FFI_MM_UNHANDLED, d);
+        }
+
+        void write(const VarDecl &d) override {
+            end_decl(write_var(d));
+        }
+
+        void write(const VarTemplateDecl &d) override {
+            uint32_t i = write_var(d);
+
+            _decls[i].flags |= C2FFI_MM_TEMPLATE;
+            end_decl(i);
+        }
+
+        void write(const FunctionDecl &d) override {
+            uint32_t i = begin_decl(C2FFI_MM_FUNCTION, d);
+            uint32_t ret;
+
+            if (d.is_variadic()) _decls[i].flags |= C2FFI_MM_VARIADIC;
+            if (d.is_inline()) _decls[i].flags |= C2FFI_MM_INLINE;
+
+            add_fields(i, d.fields());
+            ret = type(d.return_type());
+            _decls[i].type = ret;
+            end_decl(i);
+        }
+
+        void write(const TypedefDecl &d) override {
+            end_decl(write_typed(C2FFI_MM_TYPEDEF, d));
+        }
+
+        void write(const RecordDecl &d) override {
+            end_decl(write_record(d.is_union() ? C2FFI_MM_UNION : C2FFI_MM_STRUCT, d));
+        }
+
+        void write(const CXXRecordDecl &d) override {
+            end_decl(write_record(d.is_union() ? C2FFI_MM_UNION :
+                                  (d.is_class() ? C2FFI_MM_CLASS : C2FFI_MM_STRUCT), d));
+        }
+
+        void write(const CXXNamespaceDecl &d) override {
+            write_named(C2FFI_MM_NAMESPACE, d);
+        }
+
+        void write(const TypeAliasDecl &d) override {
+            end_decl(write_typed(C2FFI_MM_TYPE_ALIAS, d));
+        }
+
+        void write(const TypeAliasTemplateDecl &d) override {
+            uint32_t i = write_typed(C2FFI_MM_TYPE_ALIAS, d);
+
+            _decls[i].flags |= C2FFI_MM_TEMPLATE;
+            end_decl(i);
+        }
+
+        void write(const UsingDecl &d) override {
+            write_named(C2FFI_MM_USING, d);
+        }
+
+        void write(const UsingShadowDecl &d) override {
+            write_named(C2FFI_MM_USING_SHADOW, d);
+        }
+
+        void write(const UsingDirectiveDecl &d) override {
+            write_named(C2FFI_MM_USING_DIRECTIVE, d);
+        }
+
+        void write(const EnumDecl &d) override {
+            uint32_t i = begin_decl(C2FFI_MM_ENUM, d);
+
+            _decls[i].first_field = (uint32_t) _fields.size();
+            _decls[i].field_count = (uint32_t) d.fields().size();
+
+            for (auto &f : d.fields()) {
+                c2ffi_mm_field r;
+
+                memset(&r, 0, sizeof(r));
+                r.name = str(f.first);
+                r.type = C2FFI_MM_NONE;
+                r.bit_offset = f.second;
+                _fields.push_back(r);
+            }
+
+            end_decl(i);
+        }
+
+        void write(const ObjCInterfaceDecl &d) override {
+            uint32_t i = begin_decl(C2FFI_MM_OBJC_INTERFACE, d);
+
+            if (d.is_forward()) _decls[i].flags |= C2FFI_MM_FORWARD;
+            add_fields(i, d.fields());
+            end_decl(i);
+        }
+
+        void write(const ObjCCategoryDecl &d) override {
+            write_named(C2FFI_MM_OBJC_CATEGORY, d);
+        }
+
+        void write(const ObjCProtocolDecl &d) override {
+            write_named(C2FFI_MM_OBJC_PROTOCOL, d);
+        }
+
+        void write(const ForwardDecl &d) override {
+            uint32_t i = begin_decl(forward_kind(d.kind()), d);
+
+            _decls[i].flags |= C2FFI_MM_FORWARD;
+            end_decl(i);
+        }
+    };
+
+    OutputDriver *MakeMMSpecOutputDriver(std::ostream *os) {
+        return new MMSpecOutputDriver(os);
+    }
+}
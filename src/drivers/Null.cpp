@@ -68,6 +68,8 @@ namespace c2ffi {
         virtual void write(const ObjCCategoryDecl &d) {}
 
         virtual void write(const ObjCProtocolDecl &d) {}
+
+        virtual bool writes_decls() const { return false; }
     };
 
     OutputDriver *MakeNullOutputDriver(std::ostream *os) {
@@ -0,0 +1,633 @@
+/* -*- c++ -*-
+
+   c2ffi
+   Copyright (C) 2013  Ryan Pavlik
+
+   This file is part of c2ffi.
+
+   c2ffi is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   c2ffi is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef C2FFI_HAVE_SQLITE
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <string>
+#include <vector>
+
+#include <sqlite3.h>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+
+#include "c2ffi.h"
+
+using namespace c2ffi;
+
+/* Tags are those the json driver writes.  decls.parent is the record
+   a method belongs to, or the declaration an inline one (such as an
+   anonymous struct in a typedef) is written in.  types.target is what
+   a pointer, reference, array or bitfield is of, and types.decl the
+   inline declaration a "decl" type stands for.  flags holds words such
+   as "variadic", "inline", "virtual" and "forward".  parents are the
+   base classes of a C++ record.  A type known only by name, such as a
+   typedef, has that name as its tag, as in json, and in types.name. */
+static const char schema[] = R"(
+CREATE TABLE decls (
+    id INTEGER PRIMARY KEY,
+    parent INTEGER,
+    tag TEXT NOT NULL,
+    name TEXT,
+    ns INTEGER,
+    c2ffi_id INTEGER,
+    file TEXT,
+    line INTEGER,
+    col INTEGER,
+    usr TEXT,
+    type INTEGER,
+    value TEXT,
+    bit_size INTEGER,
+    bit_alignment INTEGER,
+    storage_class TEXT,
+    flags TEXT
+);
+CREATE TABLE types (
+    id INTEGER PRIMARY KEY,
+    tag TEXT NOT NULL,
+    name TEXT,
+    c2ffi_id INTEGER,
+    bit_size INTEGER,
+    bit_alignment INTEGER,
+    size INTEGER,
+    target INTEGER,
+    decl INTEGER
+);
+CREATE TABLE fields (
+    decl INTEGER NOT NULL,
+    position INTEGER NOT NULL,
+    name TEXT,
+    type INTEGER,
+    bit_offset INTEGER,
+    bit_size INTEGER,
+    bit_alignment INTEGER
+);
+CREATE TABLE parameters (
+    decl INTEGER NOT NULL,
+    position INTEGER NOT NULL,
+    name TEXT,
+    type INTEGER
+);
+CREATE TABLE enum_values (
+    decl INTEGER NOT NULL,
+    position INTEGER NOT NULL,
+    name TEXT,
+    value INTEGER
+);
+CREATE TABLE parents (
+    decl INTEGER NOT NULL,
+    position INTEGER NOT NULL,
+    name TEXT,
+    offset INTEGER,
+    virtual INTEGER,
+    access TEXT
+);
+)";
+
+// Built once everything is in, which is faster than keeping them
+// up to date row by row
+static const char indexes[] = R"(
+CREATE INDEX decls_name ON decls (name);
+CREATE INDEX decls_tag ON decls (tag);
+CREATE INDEX decls_parent ON decls (parent);
+CREATE INDEX decls_c2ffi_id ON decls (c2ffi_id);
+CREATE INDEX types_tag ON types (tag);
+CREATE INDEX types_name ON types (name);
+CREATE INDEX types_target ON types (target);
+CREATE INDEX fields_decl ON fields (decl);
+CREATE INDEX fields_type ON fields (type);
+CREATE INDEX parameters_decl ON parameters (decl);
+CREATE INDEX parameters_type ON parameters (type);
+CREATE INDEX enum_values_decl ON enum_values (decl);
+CREATE INDEX enum_values_name ON enum_values (name);
+CREATE INDEX parents_decl ON parents (decl);
+)";
+
+namespace c2ffi {
+    class SQLiteOutputDriver : public OutputDriver {
+        // A prepared insert; values are bound in column order
+        class Insert {
+            sqlite3 *_db;
+            sqlite3_stmt *_s;
+            int _n;
+
+        public:
+            Insert() : _db(nullptr), _s(nullptr), _n(0) {}
+
+            ~Insert() { sqlite3_finalize(_s); }
+
+            void prepare(sqlite3 *db, const char *sql) {
+                _db = db;
+
+                if (sqlite3_prepare_v2(db, sql, -1, &_s, nullptr) != SQLITE_OK)
+                    fail(db);
+            }
+
+            Insert &operator<<(int64_t v) {
+                sqlite3_bind_int64(_s, ++_n, v);
+                return *this;
+            }
+
+            Insert &operator<<(const std::string &v) {
+                sqlite3_bind_text(_s, ++_n, v.data(), (int) v.size(), SQLITE_TRANSIENT);
+                return *this;
+            }
+
+            Insert &null() {
+                sqlite3_bind_null(_s, ++_n);
+                return *this;
+            }
+
+            // Row ids start at 1, so 0 is "none"
+            Insert &ref(int64_t id) { return id ? *this << id : null(); }
+
+            Insert &text(const std::string &v) { return v.empty() ? null() : *this << v; }
+
+            void run() {
+                if (sqlite3_step(_s) != SQLITE_DONE)
+                    fail(_db);
+
+                sqlite3_reset(_s);
+                sqlite3_clear_bindings(_s);
+                _n = 0;
+            }
+
+            void finalize() {
+                sqlite3_finalize(_s);
+                _s = nullptr;
+            }
+        };
+
+        // A declaration being written; its row goes in once its
+        // fields and types have
+        struct Row {
+            int64_t id;
+            const char *tag;
+            const Decl *d;
+            int64_t type;
+            std::string value;
+            int64_t bit_size;
+            int64_t bit_alignment;
+            std::string storage_class;
+            std::string flags;
+        };
+
+        std::string _path;
+        sqlite3 *_db;
+
+        Insert _decls;
+        Insert _types;
+        Insert _fields;
+        Insert _parameters;
+        Insert _enum_values;
+        Insert _parents;
+
+        std::vector<Row> _rows;
+        int64_t _next_decl;
+        int64_t _next_type;
+        unsigned long _pending;
+
+        std::unordered_map<std::string, int64_t> _type_index;
+
+        // Set by each write(Type)
+        int64_t _last_type;
+        unsigned _type_depth;
+
+        static void fail(sqlite3 *db) {
+            std::cerr << "Error: sqlite: " << sqlite3_errmsg(db) << std::endl;
+            exit(1);
+        }
+
+        void exec(const char *sql) {
+            if (sqlite3_exec(_db, sql, nullptr, nullptr, nullptr) != SQLITE_OK)
+                fail(_db);
+        }
+
+        // Identical types share one row
+        void intern(const char *tag, const std::string &name,
+                    int64_t c2ffi_id = 0, int64_t bit_size = -1,
+                    int64_t bit_alignment = -1, int64_t size = -1,
+                    int64_t target = 0, int64_t decl = 0) {
+            std::string key = std::string(tag) + '\0' + name + '\0' +
+                              std::to_string(c2ffi_id) + ' ' +
+                              std::to_string(bit_size) + ' ' +
+                              std::to_string(bit_alignment) + ' ' +
+                              std::to_string(size) + ' ' +
+                              std::to_string(target) + ' ' +
+                              std::to_string(decl);
+            auto it = _type_index.find(key);
+
+            if (it != _type_index.end()) {
+                _last_type = it->second;
+                return;
+            }
+
+            _last_type = _next_type++;
+            _type_index[key] = _last_type;
+
+            _types << _last_type << std::string(tag);
+            _types.text(name);
+            c2ffi_id ? _types << c2ffi_id : _types.null();
+            bit_size >= 0 ? _types << bit_size : _types.null();
+            bit_alignment >= 0 ? _types << bit_alignment : _types.null();
+            size >= 0 ? _types << size : _types.null();
+            _types.ref(target).ref(decl).run();
+        }
+
+        int64_t type(const Type &t) {
+            _last_type = 0;
+            _type_depth++;
+            write(t);
+            _type_depth--;
+
+            return _last_type;
+        }
+
+        int64_t begin_decl(const char *tag, const Decl &d) {
+            _rows.push_back({_next_decl++, tag, &d, 0, std::string(), -1, -1,
+                             std::string(), std::string()});
+            return _rows.back().id;
+        }
+
+        Row &row() { return _rows.back(); }
+
+        void flag(const char *f, bool on = true) {
+            if (!on) return;
+
+            if (!row().flags.empty()) row().flags += ' ';
+            row().flags += f;
+        }
+
+        void end_decl() {
+            Row r = std::move(_rows.back());
+            _rows.pop_back();
+
+            const Decl &d = *r.d;
+            int64_t parent = _rows.empty() ? 0 : _rows.back().id;
+
+            _decls << r.id;
+            _decls.ref(parent) << std::string(r.tag);
+            _decls.text(d.name());
+            _decls.ref(d.ns()).ref(d.id());
+
+            if (d.file())
+                _decls << d.file()->path << (int64_t) d.line() << (int64_t) d.column();
+            else
+                _decls.null().null().null();
+
+            _decls.text(d.usr()).ref(r.type).text(r.value);
+            r.bit_size >= 0 ? _decls << r.bit_size : _decls.null();
+            r.bit_alignment >= 0 ? _decls << r.bit_alignment : _decls.null();
+            _decls.text(r.storage_class).text(r.flags).run();
+
+            // A declaration written as a type stands for that type
+            if (_type_depth)
+                intern("decl", std::string(), 0, -1, -1, -1, 0, r.id);
+
+            // Committed in batches
+            if (_rows.empty() && ++_pending == 10000) {
+                exec("COMMIT; BEGIN");
+                _pending = 0;
+            }
+        }
+
+        void add_fields(int64_t decl, const NameTypeVector &fields) {
+            int64_t position = 0;
+
+            for (auto &f : fields) {
+                int64_t t = type(*f.second);
+
+                _fields << decl << position++;
+                _fields.text(f.first).ref(t)
+                        << (int64_t) f.second->bit_offset()
+                        << (int64_t) f.second->bit_size()
+                        << (int64_t) f.second->bit_alignment();
+                _fields.run();
+            }
+        }
+
+        void add_parameters(int64_t decl, const NameTypeVector &params) {
+            int64_t position = 0;
+
+            for (auto &p : params) {
+                int64_t t = type(*p.second);
+
+                _parameters << decl << position++;
+                _parameters.text(p.first).ref(t).run();
+            }
+        }
+
+        void add_functions(const FunctionVector &funcs) {
+            for (auto *f : funcs)
+                write((const Writable &) *f);
+        }
+
+        void write_record(const char *tag, const RecordDecl &d) {
+            int64_t id = begin_decl(tag, d);
+
+            row().bit_size = d.bit_size();
+            row().bit_alignment = d.bit_alignment();
+            add_fields(id, d.fields());
+        }
+
+        void write_typed(const char *tag, const TypeDecl &d) {
+            begin_decl(tag, d);
+            int64_t t = type(d.type());
+            row().type = t;
+        }
+
+        void write_function(const char *tag, const FunctionDecl &d) {
+            int64_t id = begin_decl(tag, d);
+
+            add_parameters(id, d.fields());
+            int64_t t = type(d.return_type());
+
+            row().type = t;
+            row().storage_class = d.storage_class();
+            flag("variadic", d.is_variadic());
+            flag("inline", d.is_inline());
+            flag("class-method", d.is_objc_method() && d.is_class_method());
+        }
+
+        void write_named(const char *tag, const Decl &d) {
+            begin_decl(tag, d);
+            end_decl();
+        }
+
+    public:
+        explicit SQLiteOutputDriver(std::ostream *os)
+                : OutputDriver(os), _db(nullptr), _next_decl(1),
+                  _next_type(1), _pending(0), _last_type(0),
+                  _type_depth(0) {}
+
+        ~SQLiteOutputDriver() override {
+            if (_db) sqlite3_close(_db);
+        }
+
+        using OutputDriver::write;
+
+        /* SQLite needs a file of its own, so the database is built in a
+           temporary one and copied to the output at the end. */
+        void write_header() override {
+            llvm::SmallString<128> path;
+
+            if (llvm::sys::fs::createTemporaryFile("c2ffi", "sqlite", path)) {
+                std::cerr << "Error: cannot create a temporary file" << std::endl;
+                exit(1);
+            }
+
+            _path = path.c_str();
+
+            if (sqlite3_open(_path.c_str(), &_db) != SQLITE_OK)
+                fail(_db);
+
+            // Nothing is lost if it is interrupted but the whole run
+            exec("PRAGMA journal_mode = OFF; PRAGMA synchronous = OFF");
+            exec(schema);
+
+            _decls.prepare(_db, "INSERT INTO decls VALUES "
+                                "(?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
+            _types.prepare(_db, "INSERT INTO types VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)");
+            _fields.prepare(_db, "INSERT INTO fields VALUES (?, ?, ?, ?, ?, ?, ?)");
+            _parameters.prepare(_db, "INSERT INTO parameters VALUES (?, ?, ?, ?)");
+            _enum_values.prepare(_db, "INSERT INTO enum_values VALUES (?, ?, ?, ?)");
+            _parents.prepare(_db, "INSERT INTO parents VALUES (?, ?, ?, ?, ?, ?)");
+
+            exec("BEGIN");
+        }
+
+        void write_footer() override {
+            exec("COMMIT");
+            exec(indexes);
+
+            _decls.finalize();
+            _types.finalize();
+            _fields.finalize();
+            _parameters.finalize();
+            _enum_values.finalize();
+            _parents.finalize();
+
+            if (sqlite3_close(_db) != SQLITE_OK)
+                fail(_db);
+            _db = nullptr;
+
+            std::ifstream in(_path, std::ios::binary);
+            char buf[1 << 16];
+
+            while (in.read(buf, sizeof(buf)) || in.gcount())
+                os().write(buf, (size_t) in.gcount());
+
+            in.close();
+            llvm::sys::fs::remove(_path);
+        }
+
+        // Types -----------------------------------------------------------
+        void write(const SimpleType &t) override {
+            intern(t.name().c_str(), t.name());
+        }
+
+        void write(const BasicType &t) override {
+            intern(t.name().c_str(), std::string(), 0, t.bit_size(), t.bit_alignment());
+        }
+
+        void write(const BitfieldType &t) override {
+            int64_t base = type(*t.base());
+            intern(":bitfield", std::string(), 0, -1, -1, t.width(), base);
+        }
+
+        void write(const PointerType &t) override {
+            int64_t target = type(t.pointee());
+            intern(":pointer", std::string(), 0, -1, -1, -1, target);
+        }
+
+        void write(const ReferenceType &t) override {
+            int64_t target = type(t.pointee());
+            intern(":reference", std::string(), 0, -1, -1, -1, target);
+        }
+
+        void write(const ArrayType &t) override {
+            int64_t target = type(t.pointee());
+            intern(":array", std::string(), 0, -1, -1, t.size(), target);
+        }
+
+        void write(const RecordType &t) override {
+            intern(t.is_union() ? ":union" : (t.is_class() ? ":class" : ":struct"),
+                   t.name(), t.id());
+        }
+
+        void write(const EnumType &t) override {
+            intern(":enum", t.name(), t.id());
+        }
+
+        // Decls -----------------------------------------------------------
+        void write(const UnhandledDecl &d) override {
+            begin_decl("unhandled", d);
+            row().value = d.kind();
+            end_decl();
+        }
+
+        void write(const VarDecl &d) override {
+            write_typed(d.is_extern() ? "extern" : "const", d);
+            row().value = d.value();
+            flag("string", d.is_string());
+            end_decl();
+        }
+
+        void write(const FunctionDecl &d) override {
+            write_function("function", d);
+            end_decl();
+        }
+
+        void write(const CXXFunctionDecl &d) override {
+            write_function("function", d);
+            flag("static", d.is_static());
+            flag("virtual", d.is_virtual());
+            flag("pure", d.is_pure());
+            flag("const", d.is_const());
+            end_decl();
+        }
+
+        void write(const TypedefDecl &d) override {
+            write_typed("typedef", d);
+            end_decl();
+        }
+
+        void write(const RecordDecl &d) override {
+            write_record(d.is_union() ? "union" : "struct", d);
+            end_decl();
+        }
+
+        void write(const CXXRecordDecl &d) override {
+            write_record(d.is_union() ? "union" : (d.is_class() ? "class" : "struct"), d);
+
+            int64_t id = row().id;
+            int64_t position = 0;
+
+            for (auto &p : d.parents()) {
+                _parents << id << position++;
+                _parents.text(p.name) << (int64_t) p.parent_offset
+                                      << (int64_t) p.is_virtual;
+
+                switch (p.access) {
+                    case CXXRecordDecl::access_private:
+                        _parents << std::string("private");
+                        break;
+                    case CXXRecordDecl::access_protected:
+                        _parents << std::string("protected");
+                        break;
+                    case CXXRecordDecl::access_public:
+                        _parents << std::string("public");
+                        break;
+                    default:
+                        _parents.null();
+                }
+
+                _parents.run();
+            }
+
+            add_functions(d.functions());
+            end_decl();
+        }
+
+        void write(const CXXNamespaceDecl &d) override {
+            write_named("namespace", d);
+        }
+
+        void write(const TypeAliasDecl &d) override {
+            write_typed("type-alias", d);
+            end_decl();
+        }
+
+        void write(const TypeAliasTemplateDecl &d) override {
+            write_typed("type-alias-template", d);
+            end_decl();
+        }
+
+        void write(const VarTemplateDecl &d) override {
+            write_typed("var-template", d);
+            end_decl();
+        }
+
+        void write(const UsingDecl &d) override {
+            write_named("using", d);
+        }
+
+        void write(const UsingShadowDecl &d) override {
+            write_named("using-shadow", d);
+        }
+
+        void write(const UsingDirectiveDecl &d) override {
+            write_named("using-directive", d);
+        }
+
+        void write(const EnumDecl &d) override {
+            int64_t id = begin_decl("enum", d);
+            int64_t position = 0;
+
+            for (auto &f : d.fields()) {
+                _enum_values << id << position++;
+                _enum_values.text(f.first) << (int64_t) f.second;
+                _enum_values.run();
+            }
+
+            end_decl();
+        }
+
+        void write(const ObjCInterfaceDecl &d) override {
+            int64_t id = begin_decl(d.is_forward() ? "@class" : "@interface", d);
+
+            row().value = d.super();
+            flag("forward", d.is_forward());
+            add_fields(id, d.fields());
+            add_functions(d.functions());
+            end_decl();
+        }
+
+        void write(const ObjCCategoryDecl &d) override {
+            begin_decl("@category", d);
+            row().value = d.category();
+            add_functions(d.functions());
+            end_decl();
+        }
+
+        void write(const ObjCProtocolDecl &d) override {
+            begin_decl("@protocol", d);
+            add_functions(d.functions());
+            end_decl();
+        }
+
+        void write(const ForwardDecl &d) override {
+            begin_decl("forward", d);
+            row().value = d.kind();
+            end_decl();
+        }
+    };
+
+    OutputDriver *MakeSQLiteOutputDriver(std::ostream *os) {
+        return new SQLiteOutputDriver(os);
+    }
+}
+
+#endif /* C2FFI_HAVE_SQLITE */
@@ -19,6 +19,12 @@
    along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 #include "c2ffi.h"
 
 using namespace c2ffi;
@@ -27,7 +33,68 @@ namespace c2ffi {
     class SexpOutputDriver : public OutputDriver {
         int _level;
 
-        void endl() { if (_level <= 1) os() << std::endl; }
+        // Where forms are written: os(), or a scratch buffer while a
+        // declaration or type is rendered for --type-table
+        OutputSink *_out;
+
+        struct Scratch {
+            std::ostringstream ss;
+            OutputSink sink;
+
+            Scratch() : sink(&ss) {}
+        };
+
+        // --type-table: each distinct type is written once, as a
+        // top-level (type ID TYPE) form ahead of the first declaration
+        // using it, and as (:type ID) everywhere
+        bool _types;
+        std::vector<std::unique_ptr<Scratch>> _scratch;
+        size_t _depth;
+        std::unordered_map<std::string, uint64_t> _type_ids;
+
+        OutputSink &out() { return *_out; }
+
+        void begin_scratch() {
+            if (_depth == _scratch.size())
+                _scratch.emplace_back(new Scratch);
+
+            _out = &_scratch[_depth++]->sink;
+        }
+
+        // What was written since begin_scratch()
+        std::string end_scratch() {
+            Scratch &s = *_scratch[--_depth];
+
+            s.sink.flush();
+            std::string text = s.ss.str();
+            s.ss.str(std::string());
+
+            _out = _depth ? &_scratch[_depth - 1]->sink : &os();
+            return text;
+        }
+
+        void type(const Type &t) {
+            if (!_types) {
+                write(t);
+                return;
+            }
+
+            // Types inside this one are interned first, so the text is
+            // the same wherever it is used
+            begin_scratch();
+            write(t);
+            std::string text = end_scratch();
+
+            auto i = _type_ids.emplace(std::move(text), _type_ids.size() + 1);
+
+            if (i.second)
+                os() << "(type " << i.first->second << " " << i.first->first
+                     << ")\n";
+
+            out() << "(:type " << i.first->second << ")";
+        }
+
+        void endl() { if (_level <= 1) out() << '\n'; }
 
         void write_fields(const NameTypeVector &fields,
                           std::string pre = "",
@@ -35,50 +102,50 @@ namespace c2ffi {
             std::string spaces(_level * 2, ' ');
             std::string spaces_pad(pre.size(), ' ');
 
-            os() << std::endl << spaces << pre;
+            out() << '\n' << spaces << pre;
 
             for (NameTypeVector::const_iterator i = fields.begin();
                  i != fields.end(); i++) {
                 if (i != fields.begin())
-                    os() << std::endl << spaces << spaces_pad;
+                    out() << '\n' << spaces << spaces_pad;
 
-                os() << "(" << i->first << " ";
-                write(*(i->second));
-                os() << ")";
+                out() << "(" << i->first << " ";
+                type(*(i->second));
+                out() << ")";
             }
 
-            os() << post;
+            out() << post;
         }
 
         void write_functions(const FunctionVector &funcs) {
             std::string spaces(_level * 2, ' ');
 
-            os() << std::endl << spaces << '(';
+            out() << '\n' << spaces << '(';
 
             for (FunctionVector::const_iterator i = funcs.begin();
                  i != funcs.end(); i++) {
                 if (i != funcs.begin())
-                    os() << std::endl << spaces << " ";
+                    out() << '\n' << spaces << " ";
 
                 if ((*i)->is_objc_method()) {
-                    os() << "(";
+                    out() << "(";
                     if ((*i)->is_class_method())
-                        os() << "@+ ";
+                        out() << "@+ ";
                     else
-                        os() << "@- ";
+                        out() << "@- ";
                 }
 
                 write(*(*i));
 
                 if ((*i)->is_objc_method())
-                    os() << ")";
+                    out() << ")";
             }
 
-            os() << ')';
+            out() << ')';
         }
 
         void maybe_write_location(const Decl &d) {
-            if (d.location() != "") {
+            if (d.file() || !d.spelled_location().empty()) {
                 endl();
                 write_comment(d.location().c_str());
             }
@@ -86,81 +153,111 @@ namespace c2ffi {
 
     public:
         SexpOutputDriver(std::ostream *os)
-                : OutputDriver(os), _level(0) {}
+                : OutputDriver(os), _level(0), _out(&this->os()),
+                  _types(false), _depth(0) {}
 
         virtual void write_namespace(const std::string &ns) {
-            os() << "(in-package :" << ns << ")" << std::endl;
+            out() << "(in-package :" << ns << ")" << '\n';
         }
 
         virtual void write_comment(const char *str) {
-            os() << ";; " << str << std::endl;
+            out() << ";; " << str << '\n';
+        }
+
+        // The spec whose declarations this one leaves out
+        virtual void write_base(const std::string &path) {
+            out() << "(base \"";
+
+            for (char c : path) {
+                if (c == '"' || c == '\\') out() << '\\';
+                out() << c;
+            }
+
+            out() << "\")" << '\n';
+        }
+
+        virtual bool set_type_table() {
+            _types = true;
+            return true;
+        }
+
+        virtual void write_decl(const Decl &d) {
+            if (!_types) {
+                write(d);
+                return;
+            }
+
+            // Types it uses for the first time go out ahead of it
+            begin_scratch();
+            write(d);
+            os() << end_scratch();
         }
 
         using OutputDriver::write;
 
         // Types -----------------------------------------------------------
         virtual void write(const SimpleType &t) {
-            this->os() << t.name();
+            out() << t.name();
         }
 
         virtual void write(const BasicType &t) {
-            this->os() << t.name();
+            out() << t.name();
         }
 
         virtual void write(const BitfieldType &t) {
-            os() << "(:bitfield " << t.width() << " ";
-            write(*t.base());
-            os() << ")";
+            out() << "(:bitfield " << t.width() << " ";
+            type(*t.base());
+            out() << ")";
         }
 
         virtual void write(const PointerType &t) {
             _level++;
-            this->os() << "(:pointer ";
-            this->write(t.pointee());
-            this->os() << ")";
+            out() << "(:pointer ";
+            type(t.pointee());
+            out() << ")";
             _level--;
         }
 
         virtual void write(const ArrayType &t) {
             _level++;
-            os() << "(:array ";
-            write(t.pointee());
-            os() << " " << t.size() << ")";
+            out() << "(:array ";
+            type(t.pointee());
+            out() << " " << t.size() << ")";
             _level--;
         }
 
         virtual void write(const RecordType &t) {
-            os() << "(";
+            out() << "(";
             if (t.is_union())
-                os() << ":union ";
+                out() << ":union ";
             else
-                os() << ":struct ";
+                out() << ":struct ";
 
             if (t.name() == "")
-                os() << ":id " << t.id();
+                out() << ":id " << t.id();
             else
-                os() << t.name();
+                out() << t.name();
 
-            os() << ")";
+            out() << ")";
         }
 
         virtual void write(const EnumType &t) {
-            os() << "(:enum ";
+            out() << "(:enum ";
 
             if (t.name() == "")
-                os() << ":id " << t.id();
+                out() << ":id " << t.id();
             else
-                os() << t.name();
+                out() << t.name();
 
-            os() << ")";
+            out() << ")";
         }
 
         // Decls -----------------------------------------------------------
         virtual void write(const UnhandledDecl &d) {
             _level++;
-            os() << ";; Unhandled: <" << d.kind() << "> " << d.name()
+            out() << ";; Unhandled: <" << d.kind() << "> " << d.name()
                  << " " << d.location();
-            os() << std::endl;
+            out() << '\n';
             _level--;
         }
 
@@ -168,17 +265,17 @@ namespace c2ffi {
             _level++;
             maybe_write_location(d);
             if (d.is_extern())
-                os() << "(extern ";
+                out() << "(extern ";
             else
-                os() << "(const ";
+                out() << "(const ";
 
-            os() << d.name() << " ";
-            write(d.type());
+            out() << d.name() << " ";
+            type(d.type());
 
             if (d.value() != "")
-                os() << " " << d.value();
+                out() << " " << d.value();
 
-            os() << ")";
+            out() << ")";
             endl();
             _level--;
         }
@@ -186,28 +283,28 @@ namespace c2ffi {
         virtual void write(const FunctionDecl &d) {
             _level++;
             maybe_write_location(d);
-            os() << "(function \"" << d.name() << "\" (";
+            out() << "(function \"" << d.name() << "\" (";
 
             const NameTypeVector &params = d.fields();
             for (NameTypeVector::const_iterator i = params.begin();
                  i != params.end(); i++) {
                 if (i != params.begin())
-                    os() << " ";
+                    out() << " ";
 
-                os() << "(" << (*i).first;
+                out() << "(" << (*i).first;
 
                 if ((*i).first != "")
-                    os() << " ";
+                    out() << " ";
 
-                write(*(*i).second);
-                os() << ")";
+                type(*(*i).second);
+                out() << ")";
             }
 
-            os() << ") ";
-            write(d.return_type());
+            out() << ") ";
+            type(d.return_type());
             if (d.is_variadic())
-                os() << " :variadic";
-            os() << ")";
+                out() << " :variadic";
+            out() << ")";
             endl();
             _level--;
         }
@@ -215,9 +312,9 @@ namespace c2ffi {
         virtual void write(const TypedefDecl &d) {
             _level++;
             maybe_write_location(d);
-            os() << "(typedef " << d.name() << " ";
-            write(d.type());
-            os() << ")";
+            out() << "(typedef " << d.name() << " ";
+            type(d.type());
+            out() << ")";
             endl();
             _level--;
         }
@@ -226,20 +323,20 @@ namespace c2ffi {
         virtual void write(const RecordDecl &d) {
             _level++;
             maybe_write_location(d);
-            os() << "(";
+            out() << "(";
 
             if (d.is_union())
-                os() << "union ";
+                out() << "union ";
             else
-                os() << "struct ";
+                out() << "struct ";
 
             if (d.name() == "")
-                os() << ":id " << d.id();
+                out() << ":id " << d.id();
             else
-                os() << d.name();
+                out() << d.name();
 
             write_fields(d.fields());
-            os() << ")";
+            out() << ")";
             endl();
             _level--;
         }
@@ -247,22 +344,22 @@ namespace c2ffi {
         virtual void write(const EnumDecl &d) {
             _level++;
             maybe_write_location(d);
-            os() << "(enum ";
+            out() << "(enum ";
 
             if (d.name() == "")
-                os() << ":id " << d.id();
+                out() << ":id " << d.id();
             else
-                os() << d.name();
+                out() << d.name();
 
             const NameNumVector &fields = d.fields();
             for (NameNumVector::const_iterator i = fields.begin();
                  i != fields.end(); i++) {
-                os() << std::endl
+                out() << '\n'
                      << "    (" << i->first << " " << i->second
                      << ")";
             }
 
-            os() << ")";
+            out() << ")";
             endl();
             _level--;
         }
@@ -271,26 +368,26 @@ namespace c2ffi {
             _level++;
             maybe_write_location(d);
             if (d.is_forward())
-                os() << "(@class " << d.name();
+                out() << "(@class " << d.name();
             else
-                os() << "(@interface " << d.name();
+                out() << "(@interface " << d.name();
 
-            os() << " (" << d.super() << ") ";
+            out() << " (" << d.super() << ") ";
 
-            os() << "(";
+            out() << "(";
             const NameVector &protos = d.protocols();
             for (NameVector::const_iterator i = protos.begin();
                  i != protos.end(); i++) {
                 if (i != protos.begin())
-                    os() << " ";
-                os() << *i;
+                    out() << " ";
+                out() << *i;
             }
-            os() << ")";
+            out() << ")";
 
             write_fields(d.fields(), "(", ")");
             write_functions(d.functions());
 
-            os() << ")";
+            out() << ")";
             endl();
             _level--;
         }
@@ -298,10 +395,10 @@ namespace c2ffi {
         virtual void write(const ObjCCategoryDecl &d) {
             _level++;
             maybe_write_location(d);
-            os() << "(@category " << d.name()
+            out() << "(@category " << d.name()
                  << " (" << d.category() << ")";
             write_functions(d.functions());
-            os() << ")";
+            out() << ")";
             endl();
             _level--;
         }
@@ -309,9 +406,25 @@ namespace c2ffi {
         virtual void write(const ObjCProtocolDecl &d) {
             _level++;
             maybe_write_location(d);
-            os() << "(@protocol " << d.name();
+            out() << "(@protocol " << d.name();
             write_functions(d.functions());
-            os() << ")";
+            out() << ")";
+            endl();
+            _level--;
+        }
+
+        // Ahead of a declaration referred to before it (--toposort)
+        virtual void write(const ForwardDecl &d) {
+            _level++;
+            maybe_write_location(d);
+            out() << "(forward " << d.kind() << " ";
+
+            if (d.name() == "")
+                out() << ":id " << d.id();
+            else
+                out() << d.name();
+
+            out() << ")";
             endl();
             _level--;
         }
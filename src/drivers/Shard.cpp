@@ -0,0 +1,250 @@
+/* -*- c++ -*-
+
+   c2ffi
+   Copyright (C) 2013  Ryan Pavlik
+
+   This file is part of c2ffi.
+
+   c2ffi is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   c2ffi is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/raw_os_ostream.h>
+
+#include "c2ffi.h"
+#include "c2ffi/shard.h"
+
+using namespace c2ffi;
+
+namespace c2ffi {
+    class ShardOutputDriver : public OutputDriver {
+        struct Shard {
+            std::string header;
+            std::string file;
+            std::ofstream out;
+            std::unique_ptr<OutputDriver> od;
+            bool mid = false;
+            unsigned long decls = 0;
+        };
+
+        std::string _dir;
+        std::string _driver;
+        MakeOutputDriver _make;
+
+        std::string _ns;
+        std::string _base;
+        bool _type_table;
+        bool _file_table;
+
+        // In order of first declaration
+        std::vector<std::unique_ptr<Shard>> _shards;
+        std::unordered_map<std::string, Shard *> _by_header;
+        std::set<std::string> _files;
+
+        // Only this shard's stream is open, so a header per file can't
+        // run out of descriptors
+        Shard *_open;
+
+        void open(Shard *s, bool create) {
+            if (_open == s) return;
+
+            if (_open) {
+                _open->od->os().flush();
+                _open->out.close();
+            }
+
+            std::string path = _dir + "/" + s->file;
+            s->out.open(path, std::ios::out | std::ios::binary |
+                              (create ? std::ios::trunc : std::ios::app));
+
+            if (!s->out.is_open()) {
+                std::cerr << "Error: cannot write " << path << std::endl;
+                exit(1);
+            }
+
+            _open = s;
+        }
+
+        // Named after the header, then -2, -3 ... when that's taken
+        std::string shard_file(llvm::StringRef header) {
+            llvm::StringRef base = header.substr(header.find_last_of("/\\") + 1);
+            if (base.empty()) base = "builtin";
+
+            std::string file = base.str() + "." + _driver;
+
+            for (int n = 2; !_files.insert(file).second; n++)
+                file = base.str() + "-" + std::to_string(n) + "." + _driver;
+
+            return file;
+        }
+
+        Shard *shard(llvm::StringRef header) {
+            auto i = _by_header.find(header.str());
+            if (i != _by_header.end())
+                return i->second;
+
+            Shard *s = new Shard;
+            _shards.emplace_back(s);
+            _by_header[header.str()] = s;
+
+            s->header = header.str();
+            s->file = shard_file(header);
+
+            open(s, true);
+            s->od.reset(_make(&s->out));
+
+            if (_type_table)
+                s->od->set_type_table();
+
+            if (_file_table)
+                s->od->set_file_table();
+
+            s->od->write_header();
+
+            if (!_ns.empty())
+                s->od->write_namespace(_ns);
+
+            if (!_base.empty())
+                s->od->write_base(_base);
+
+            return s;
+        }
+
+        void write_manifest() {
+            std::string path = _dir + "/manifest.json";
+            std::ofstream file(path);
+
+            if (!file.is_open()) {
+                std::cerr << "Error: cannot write " << path << std::endl;
+                exit(1);
+            }
+
+            llvm::raw_os_ostream out(file);
+
+            out << "{ \"driver\": " << llvm::json::Value(_driver)
+                << ", \"shards\": [";
+
+            for (auto i = _shards.begin(); i != _shards.end(); ++i) {
+                if (i != _shards.begin())
+                    out << ",";
+
+                out << "\n  { \"header\": " << llvm::json::Value((*i)->header)
+                    << ", \"file\": " << llvm::json::Value((*i)->file)
+                    << ", \"declarations\": " << (uint64_t) (*i)->decls << " }";
+            }
+
+            out << "\n] }\n";
+        }
+
+    public:
+        ShardOutputDriver(const std::string &dir, const std::string &driver,
+                          MakeOutputDriver make)
+                : OutputDriver(nullptr), _dir(dir), _driver(driver),
+                  _make(make), _type_table(false), _file_table(false), _open(nullptr) {}
+
+        // Each shard gets type and file tables of its own
+        bool set_type_table() override {
+            _type_table = true;
+            return true;
+        }
+
+        bool set_file_table() override {
+            _file_table = true;
+            return true;
+        }
+
+        // Each shard has its own header, separators and footer
+        void write_namespace(const std::string &ns) override { _ns = ns; }
+
+        void write_base(const std::string &path) override { _base = path; }
+
+        void write_footer() override {
+            for (auto &s : _shards) {
+                open(s.get(), false);
+                s->od->write_footer();
+            }
+
+            if (_open) {
+                _open->od->os().flush();
+                _open->out.close();
+                _open = nullptr;
+            }
+
+            write_manifest();
+        }
+
+        void write_decl(const Decl &d) override {
+            // Declarations without a location share a shard
+            Shard *s = shard(d.file() ? llvm::StringRef(d.file()->path)
+                                      : llvm::StringRef());
+
+            open(s, false);
+
+            if (s->mid) s->od->write_between();
+            else s->mid = true;
+
+            s->od->write_decl(d);
+            s->decls++;
+        }
+
+        // Only whole declarations reach this driver
+        void write(const SimpleType &) override {}
+
+        void write(const BasicType &) override {}
+
+        void write(const BitfieldType &) override {}
+
+        void write(const PointerType &) override {}
+
+        void write(const ArrayType &) override {}
+
+        void write(const RecordType &) override {}
+
+        void write(const EnumType &) override {}
+
+        void write(const UnhandledDecl &d) override {}
+
+        void write(const VarDecl &d) override {}
+
+        void write(const FunctionDecl &d) override {}
+
+        void write(const TypedefDecl &d) override {}
+
+        void write(const RecordDecl &d) override {}
+
+        void write(const EnumDecl &d) override {}
+    };
+}
+
+OutputDriver *c2ffi::MakeShardOutputDriver(const std::string &dir,
+                                           const std::string &driver,
+                                           MakeOutputDriver make) {
+    std::error_code ec = llvm::sys::fs::create_directories(dir);
+
+    if (ec) {
+        std::cerr << "Error: cannot create " << dir << ": " << ec.message()
+                  << std::endl;
+        exit(1);
+    }
+
+    return new ShardOutputDriver(dir, driver, make);
+}
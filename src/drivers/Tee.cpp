@@ -0,0 +1,190 @@
+/* -*- c++ -*-
+
+   c2ffi
+   Copyright (C) 2013  Ryan Pavlik
+
+   This file is part of c2ffi.
+
+   c2ffi is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   c2ffi is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "c2ffi.h"
+#include "c2ffi/compress.h"
+#include "c2ffi/tee.h"
+
+using namespace c2ffi;
+
+namespace c2ffi {
+    class TeeOutputDriver : public OutputDriver {
+        // Members go in reverse, so the driver goes before its stream
+        struct Output {
+            // Null for the primary driver, whose stream main() finishes
+            std::unique_ptr<std::ofstream> file;
+            std::unique_ptr<CompressStream> compressed;
+
+            std::unique_ptr<OutputDriver> od;
+        };
+
+        std::vector<Output> _outputs;
+
+    public:
+        TeeOutputDriver() : OutputDriver(nullptr) {}
+
+        void add(OutputDriver *od, std::ofstream *file = nullptr,
+                 CompressStream *compressed = nullptr) {
+            _outputs.emplace_back();
+            _outputs.back().od.reset(od);
+            _outputs.back().file.reset(file);
+            _outputs.back().compressed.reset(compressed);
+        }
+
+        // Every driver must manage it
+        bool set_type_table() override {
+            bool ok = true;
+
+            for (auto &o : _outputs)
+                ok = o.od->set_type_table() && ok;
+
+            return ok;
+        }
+
+        bool set_file_table() override {
+            bool ok = true;
+
+            for (auto &o : _outputs)
+                ok = o.od->set_file_table() && ok;
+
+            return ok;
+        }
+
+        // The index describes the first output
+        bool set_index(std::ostream *index) override {
+            return _outputs.front().od->set_index(index);
+        }
+
+        void write_header() override {
+            for (auto &o : _outputs)
+                o.od->write_header();
+        }
+
+        void write_namespace(const std::string &ns) override {
+            for (auto &o : _outputs)
+                o.od->write_namespace(ns);
+        }
+
+        void write_base(const std::string &path) override {
+            for (auto &o : _outputs)
+                o.od->write_base(path);
+        }
+
+        void write_between() override {
+            for (auto &o : _outputs)
+                o.od->write_between();
+        }
+
+        void write_comment(const char *text) override {
+            for (auto &o : _outputs)
+                o.od->write_comment(text);
+        }
+
+        void write_footer() override {
+            for (auto &o : _outputs) {
+                o.od->write_footer();
+                o.od->os().flush();
+
+                if (o.compressed && !o.compressed->finish())
+                    exit(1);
+
+                if (o.file)
+                    o.file->close();
+            }
+        }
+
+        void write_decl(const Decl &d) override {
+            for (auto &o : _outputs)
+                o.od->write_decl(d);
+        }
+
+        // Only whole declarations reach this driver
+        void write(const SimpleType &) override {}
+
+        void write(const BasicType &) override {}
+
+        void write(const BitfieldType &) override {}
+
+        void write(const PointerType &) override {}
+
+        void write(const ArrayType &) override {}
+
+        void write(const RecordType &) override {}
+
+        void write(const EnumType &) override {}
+
+        void write(const UnhandledDecl &d) override {}
+
+        void write(const VarDecl &d) override {}
+
+        void write(const FunctionDecl &d) override {}
+
+        void write(const TypedefDecl &d) override {}
+
+        void write(const RecordDecl &d) override {}
+
+        void write(const EnumDecl &d) override {}
+    };
+}
+
+OutputDriver *c2ffi::MakeTeeOutputDriver(OutputDriver *primary,
+                                         const TeeOutputVector &outputs) {
+    auto *tee = new TeeOutputDriver;
+
+    if (primary)
+        tee->add(primary);
+
+    for (auto &output : outputs) {
+        compress_mode mode = compress_mode_for(output.path);
+        auto *file = new std::ofstream(output.path, mode != compress_none
+                                                    ? std::ios::out | std::ios::binary
+                                                    : std::ios::out);
+
+        if (!file->is_open()) {
+            std::cerr << "Error: cannot write " << output.path << std::endl;
+            exit(1);
+        }
+
+        std::ostream *os = file;
+        CompressStream *compressed = nullptr;
+
+        if (mode != compress_none) {
+            compressed = CompressStream::make(file, mode);
+
+            if (!compressed) {
+                std::cerr << "Error: this c2ffi was built without support for "
+                          << "that compression" << std::endl;
+                exit(1);
+            }
+
+            os = compressed;
+        }
+
+        tee->add(output.make(os), file, compressed);
+    }
+
+    return tee;
+}
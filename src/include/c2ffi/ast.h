@@ -22,11 +22,17 @@
 #ifndef C2FFI_AST_H
 #define C2FFI_AST_H
 
+#include <memory>
 #include <set>
 #include <map>
+#include <string>
+#include <vector>
+#include <llvm/Support/raw_os_ostream.h>
 #include <clang/AST/ASTConsumer.h>
 #include "c2ffi.h"
+#include "c2ffi/fingerprint.h"
 #include "c2ffi/opt.h"
+#include "c2ffi/pipeline.h"
 
 #define if_cast(v, T, e) if(auto *v = llvm::dyn_cast<T>((e)))
 #define if_const_cast(v, T, e) if(const auto *v = llvm::dyn_cast<T>((e)))
@@ -35,32 +41,112 @@ namespace c2ffi {
     typedef std::set<const clang::Decl *> ClangDeclSet;
     typedef std::map<const clang::Decl *, int> ClangDeclIDMap;
 
+    class C2FFIASTConsumer;
+
+    typedef void (*DeclHandler)(C2FFIASTConsumer *, clang::Decl *);
+
+    // A declaration held back until the whole translation unit is seen
+    struct DeferredDecl {
+        clang::Decl *d;
+        const clang::NamedDecl *ns;
+        DeclHandler handler;
+    };
+
+    typedef std::vector<DeferredDecl> DeferredDeclVector;
+
     class C2FFIASTConsumer : public clang::ASTConsumer {
         config &_config;
 
         clang::CompilerInstance &_ci;
         c2ffi::OutputDriver *_od;
+        c2ffi::DeclPipeline *_pipeline;
         bool _mid;
 
+        // The declaration being processed goes to the base spec
+        bool _base;
+        bool _base_mid;
+
         ClangDeclSet _cur_decls;
         ClangDeclIDMap _decl_map;
         unsigned int _decl_id;
 
+        // With --incremental, ids go by a key which stays the same from
+        // run to run (id_key()), so copied output can be renumbered
+        std::map<std::string, unsigned int> _key_ids;
+        std::map<unsigned int, std::string> _id_keys;
+
+        // While set, declarations are collected here instead of written,
+        // and each id given out or looked up is noted
+        std::vector<Decl *> *_held;
+        std::set<unsigned int> *_ids_used;
+
         ClangDeclSet _cxx_decls;
 
         const clang::NamedDecl *_ns;
 
+        DeferredDeclVector _deferred;
+
+        // --deps output
+        std::unique_ptr<llvm::raw_os_ostream> _deps;
+
+        // --fingerprints
+        Fingerprinter _fingerprint;
+
+        void process(clang::Decl *d, DeclHandler handler);
+
+        void EmitDeferred();
+
+        std::string id_key(const clang::Decl *d) const;
+
+        // A ForwardDecl for d (--toposort)
+        void forward(const clang::Decl *d);
+
     public:
         C2FFIASTConsumer(clang::CompilerInstance &ci, config &config)
-                : _ci(ci), _od(config.od), _mid(false), _decl_id(0), _ns(nullptr),
-                  _config(config) {}
+                : _config(config), _ci(ci), _od(config.od), _pipeline(nullptr),
+                  _mid(false), _base(false), _base_mid(false), _decl_id(0),
+                  _held(nullptr), _ids_used(nullptr), _ns(nullptr) {
+            if (config.deps_output)
+                _deps.reset(new llvm::raw_os_ostream(*config.deps_output));
+        }
 
         clang::CompilerInstance &ci() { return _ci; }
 
         c2ffi::OutputDriver &od() { return *_od; }
 
+        // Declarations are handed to p instead of written directly
+        void set_pipeline(c2ffi::DeclPipeline *p) { _pipeline = p; }
+
         bool HandleTopLevelDecl(clang::DeclGroupRef d) override;
 
+        void HandleTranslationUnit(clang::ASTContext &ctx) override;
+
+        // Output is held back until the end of the translation unit
+        bool defer_output() const {
+            return !_config.roots.empty() || _config.toposort
+                   || _config.incremental;
+        }
+
+        // As HandleDecl() would have, once deferred
+        void process(const DeferredDecl &dd);
+
+        // True if d goes to the base spec, or is left out for being in it
+        bool to_base(const clang::Decl *d) const;
+
+        // d's line of --deps output, if asked for
+        void write_deps(const clang::Decl *d);
+
+        // See _held
+        void hold(std::vector<Decl *> *decls, std::set<unsigned int> *ids) {
+            _held = decls;
+            _ids_used = ids;
+        }
+
+        // The id for key, given out now if need be (--incremental)
+        unsigned int key_id(const std::string &key);
+
+        const std::string &key_of(unsigned int id) const;
+
         void HandleDecl(clang::Decl *d, const clang::NamedDecl *ns = nullptr);
 
         void HandleDeclContext(const clang::DeclContext *dc,
@@ -70,22 +156,18 @@ namespace c2ffi {
 
         void PostProcess();
 
-        Decl *proc(const clang::Decl *, Decl *);
+        void proc(const clang::Decl *, Decl *);
+
+        void emit(Decl *);
 
         bool is_cur_decl(const clang::Decl *d) const;
 
         unsigned int decl_id(const clang::Decl *d) const;
 
-        unsigned int add_decl(const clang::Decl *d) {
-            if (!d) {
-                return 0;
-            } else if (!_decl_map.count(d)) {
-                _decl_map[d] = ++_decl_id;
-                return _decl_id;
-            } else {
-                return _decl_map[d];
-            }
-        }
+        // The USR of d as selected by --usr, or an empty string
+        std::string usr(const clang::Decl *d) const;
+
+        unsigned int add_decl(const clang::Decl *d);
 
         unsigned int add_cxx_decl(const clang::Decl *d) {
             if (d) {
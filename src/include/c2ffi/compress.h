@@ -0,0 +1,65 @@
+/* -*- c++ -*-
+
+   c2ffi
+   Copyright (C) 2013  Ryan Pavlik
+
+   This file is part of c2ffi.
+
+   c2ffi is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   c2ffi is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef C2FFI_COMPRESS_H
+#define C2FFI_COMPRESS_H
+
+#include <ostream>
+#include <string>
+
+namespace c2ffi {
+    /* --compress */
+    enum compress_mode {
+        compress_none,
+        compress_gzip,
+        compress_zlib,
+        compress_zstd
+    };
+
+    // A --compress argument; false if it names no format
+    bool parse_compress_mode(const std::string &name, compress_mode &mode);
+
+    // What an output path's extension asks for (.gz, .zst)
+    compress_mode compress_mode_for(const std::string &path);
+
+    class CompressBuf;
+
+    /* An ostream compressing everything written to it into another
+       stream as it goes, so uncompressed output never reaches disk.
+       flush() makes what has been written so far decompressible;
+       finish() writes the end of the compressed stream. */
+    class CompressStream : public std::ostream {
+        CompressBuf *_buf;
+
+        explicit CompressStream(CompressBuf *buf);
+
+    public:
+        ~CompressStream() override;
+
+        // nullptr if this build can't write mode
+        static CompressStream *make(std::ostream *os, compress_mode mode);
+
+        // False, with a message on stderr, if compression failed
+        bool finish();
+    };
+}
+
+#endif /* C2FFI_COMPRESS_H */
@@ -29,9 +29,21 @@
 #include "c2ffi/type.h"
 
 namespace c2ffi {
+    /* A file declarations are in.  Each is made once, numbered from 1
+       in the order first seen, and kept until exit. */
+    struct SourceFile {
+        std::string path;
+        unsigned int id;
+    };
+
     class Decl : public Writable {
         std::string _name;
-        std::string _loc;
+        const SourceFile *_file{};
+        unsigned int _line{};
+        unsigned int _column{};
+        std::string _spelled;
+        std::string _usr;
+        uint64_t _fingerprint{};
         unsigned int _id{};
         unsigned int _nsparent{};
 
@@ -44,7 +56,19 @@ namespace c2ffi {
 
         virtual const std::string &name() const { return _name; }
 
-        virtual const std::string &location() const { return _loc; }
+        // Null, with no line or column, if the location is unknown
+        const SourceFile *file() const { return _file; }
+
+        unsigned int line() const { return _line; }
+
+        unsigned int column() const { return _column; }
+
+        // "path:line:column", clang's own text for the cases below, or empty
+        std::string location() const;
+
+        // Inside a macro expansion, "path:line:column <Spelling=...>"; with
+        // no presumed file, "<invalid>".  Empty otherwise
+        const std::string &spelled_location() const { return _spelled; }
 
         unsigned int id() const { return _id; }
 
@@ -54,9 +78,21 @@ namespace c2ffi {
 
         void set_ns(unsigned int ns) { _nsparent = ns; }
 
-        virtual void set_location(const std::string &loc) { _loc = loc; }
+        // Empty unless --usr was given
+        const std::string &usr() const { return _usr; }
+
+        void set_usr(std::string usr) { _usr = std::move(usr); }
+
+        // Zero unless --fingerprints was given
+        uint64_t fingerprint() const { return _fingerprint; }
+
+        void set_fingerprint(uint64_t fp) { _fingerprint = fp; }
+
+        void set_location(clang::CompilerInstance &ci, clang::SourceLocation loc);
 
-        virtual void set_location(clang::CompilerInstance &ci, const clang::Decl *d);
+        void set_location(clang::CompilerInstance &ci, const clang::Decl *d) {
+            set_location(ci, d->getLocation());
+        }
     };
 
     class UnhandledDecl : public Decl {
@@ -409,6 +445,66 @@ namespace c2ffi {
 
         DEFWRITER(ObjCProtocolDecl);
     };
+
+    /** Incremental output **/
+
+    // Marks that the following declarations come from a source file;
+    // name() is the path.  key() covers everything they were built
+    // from, and ids() gives the key of each declaration id they use, so
+    // a later run can copy them and renumber.
+    class SourceFileDecl : public Decl {
+    public:
+        typedef std::vector<std::pair<unsigned int, std::string>> IdVector;
+
+    private:
+        std::string _hash;
+        std::string _key;
+        IdVector _ids;
+
+    public:
+        SourceFileDecl(std::string path, std::string hash, std::string key,
+                       IdVector ids)
+                : Decl(std::move(path)), _hash(std::move(hash)),
+                  _key(std::move(key)), _ids(std::move(ids)) {}
+
+        DEFWRITER(SourceFileDecl);
+
+        const std::string &hash() const { return _hash; }
+
+        const std::string &key() const { return _key; }
+
+        const IdVector &ids() const { return _ids; }
+    };
+
+    // A declaration copied verbatim from a previous output
+    class RawDecl : public Decl {
+        std::string _text;
+
+    public:
+        explicit RawDecl(std::string text)
+                : Decl(""), _text(std::move(text)) {}
+
+        DEFWRITER(RawDecl);
+
+        const std::string &text() const { return _text; }
+    };
+
+    /** Sorted output **/
+
+    // With --toposort, announces a declaration which a cycle needs
+    // before it can be written in full; kind() is "struct", "union",
+    // "class", "enum", "typedef" or "@interface"
+    class ForwardDecl : public Decl {
+        std::string _kind;
+
+    public:
+        ForwardDecl(std::string name, std::string kind)
+                : Decl(std::move(name)), _kind(std::move(kind)) {}
+
+        DEFWRITER(ForwardDecl);
+
+        const std::string &kind() const { return _kind; }
+    };
 }
 
 #endif /* C2FFI_DECL_H */
@@ -0,0 +1,60 @@
+/* -*- c++ -*-
+
+   c2ffi
+   Copyright (C) 2013  Ryan Pavlik
+
+   This file is part of c2ffi.
+
+   c2ffi is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   c2ffi is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef C2FFI_DEPS_H
+#define C2FFI_DEPS_H
+
+#include <string>
+#include <vector>
+
+#include <llvm/Support/raw_ostream.h>
+
+#include <clang/AST/Decl.h>
+#include <clang/AST/Type.h>
+#include <clang/Basic/SourceManager.h>
+
+namespace c2ffi {
+    typedef std::vector<const clang::Decl *> ClangDeclVector;
+
+    // Append the declarations t refers to, following the same path
+    // through the type as Type::make_type.  Only the named end of the
+    // path is recorded: typedefs, records, enums and ObjC interfaces.
+    void type_deps(const clang::Type *t, ClangDeclVector &out);
+
+    // Append the declarations d refers to through field, parameter,
+    // return, variable and typedef target types, base classes, methods
+    // and template arguments.
+    void decl_deps(const clang::Decl *d, ClangDeclVector &out);
+
+    // The declaration holding the contents of d: the definition of a
+    // tag or ObjC interface, if there is one, otherwise d itself.
+    const clang::Decl *decl_definition(const clang::Decl *d);
+
+    // "struct", "typedef", "function", "@interface" and so on
+    std::string decl_kind_name(const clang::Decl *d);
+
+    // One line of --deps output: d's name, kind and file, and those of
+    // the named declarations it refers to
+    void write_decl_deps(llvm::raw_ostream &out, clang::SourceManager &sm,
+                         const clang::Decl *d);
+}
+
+#endif /* C2FFI_DEPS_H */
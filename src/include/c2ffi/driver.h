@@ -6,6 +6,7 @@
 #define C2FFI_DRIVER_H
 
 #include "c2ffi/predecl.h"
+#include "c2ffi/sink.h"
 
 #define DEFWRITER(x) virtual void write(OutputDriver &od) const override { od.write((const x&)*this); }
 
@@ -20,16 +21,19 @@ namespace c2ffi {
     };
 
     class OutputDriver {
-        std::ostream *_os;
+        OutputSink _sink;
     public:
         OutputDriver(std::ostream *os)
-                : _os(os) {}
+                : _sink(os) {}
 
         virtual ~OutputDriver() {}
 
         /**
            write_header()    - Called before other output
            write_namespace() - Called after header
+           write_base()      - Called after write_namespace() with the
+                               spec holding system declarations left out
+                               of this one (--base-spec)
            write_between()   - Called _between_ declarations, but _not_
                                after write_namespace().
            write_footer()    - Called after all other output.
@@ -38,6 +42,8 @@ namespace c2ffi {
 
         virtual void write_namespace(const std::string &ns) {}
 
+        virtual void write_base(const std::string &path) {}
+
         virtual void write_between() {}
 
         virtual void write_footer() {}
@@ -98,11 +104,47 @@ namespace c2ffi {
 
         virtual void write(const ObjCProtocolDecl &d) {}
 
+        virtual void write(const SourceFileDecl &d) {}
+
+        virtual void write(const RawDecl &d) {}
+
+        virtual void write(const ForwardDecl &d) {}
+
         virtual void write(const Writable &w) { w.write(*this); }
 
-        void set_os(std::ostream *os) { _os = os; }
+        // Each top-level declaration is written through here
+        virtual void write_decl(const Decl &d);
+
+        /**
+           Drivers which can say where in their output each top-level
+           declaration went write that to index and return true
+           (--index).  The default returns false.
+         **/
+        virtual bool set_index(std::ostream *index) { return false; }
+
+        /**
+           Drivers which can write each distinct type once and refer to
+           it by id from then on return true (--type-table).
+         **/
+        virtual bool set_type_table() { return false; }
+
+        /**
+           Drivers which write no declarations at all return false, and
+           none are built for them.
+         **/
+        virtual bool writes_decls() const { return true; }
+
+        /**
+           Drivers which can write each source file once and give
+           locations as its number, a line and a column return true
+           (--file-table).
+         **/
+        virtual bool set_file_table() { return false; }
+
+        void set_os(std::ostream *os) { _sink.set_os(os); }
 
-        std::ostream &os() { return *_os; }
+        // Output is buffered; os().flush() hands it to the stream
+        OutputSink &os() { return _sink; }
 
     };
 
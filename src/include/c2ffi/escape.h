@@ -0,0 +1,37 @@
+/* -*- c++ -*-
+
+   c2ffi
+   Copyright (C) 2013  Ryan Pavlik
+
+   This file is part of c2ffi.
+
+   c2ffi is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   c2ffi is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef C2FFI_ESCAPE_H
+#define C2FFI_ESCAPE_H
+
+#include <cstddef>
+
+namespace c2ffi {
+    // The offset of the first byte of s which a json string must escape:
+    // a backslash, a quote, or anything outside printable ASCII.  n if
+    // there is none.  Uses SSE2 or AVX2 where available.
+    size_t json_escape_scan(const char *s, size_t n);
+
+    // The same, one byte at a time; for bench/escape_bench.cpp
+    size_t json_escape_scan_scalar(const char *s, size_t n);
+}
+
+#endif /* C2FFI_ESCAPE_H */
@@ -0,0 +1,107 @@
+/* -*- c++ -*-
+
+   c2ffi
+   Copyright (C) 2013  Ryan Pavlik
+
+   This file is part of c2ffi.
+
+   c2ffi is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   c2ffi is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef C2FFI_FILTER_H
+#define C2FFI_FILTER_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/GlobPattern.h>
+#include <llvm/Support/Regex.h>
+#include <clang/AST/Decl.h>
+#include <clang/Basic/SourceManager.h>
+
+namespace c2ffi {
+    // Empty for anonymous and non-identifier names (operators,
+    // constructors, ...)
+    llvm::StringRef identifier_name(const clang::NamedDecl *d);
+
+    // Decides whether a declaration or macro is output at all, before
+    // anything is built for it.  All criteria which were given must
+    // match; each criterion matches if any of its patterns do.
+    class DeclFilter {
+    public:
+        enum Headers {
+            headers_all,
+            headers_user,
+            headers_system
+        };
+
+    private:
+        std::vector<llvm::GlobPattern> _files;
+        mutable std::vector<llvm::Regex> _names;
+        std::vector<std::string> _prefixes;
+        std::vector<std::string> _user_roots;
+        Headers _headers;
+
+        // Per-file results, keyed by FileID
+        mutable std::map<unsigned, bool> _file_cache;
+        mutable std::map<unsigned, bool> _system_cache;
+
+        bool match_name(llvm::StringRef name) const;
+
+        bool match_path(llvm::StringRef path) const;
+
+        bool match_file(const clang::SourceManager &sm,
+                        clang::SourceLocation loc) const;
+
+    public:
+        DeclFilter() : _headers(headers_all) {}
+
+        // These return false and set error on an invalid pattern
+        bool add_file_glob(const std::string &glob, std::string &error);
+
+        bool add_name_regex(const std::string &re, std::string &error);
+
+        void add_name_prefix(const std::string &prefix) { _prefixes.push_back(prefix); }
+
+        // Files below a user root are user headers, anything else is a
+        // system header
+        void add_user_root(const std::string &dir);
+
+        void set_headers(Headers h) { _headers = h; }
+
+        bool is_user_path(llvm::StringRef path) const;
+
+        // Whether loc is outside the user roots; builtins are system
+        bool is_system(const clang::SourceManager &sm,
+                       clang::SourceLocation loc) const;
+
+        bool empty() const {
+            return _files.empty() && _names.empty() && _prefixes.empty() &&
+                   _headers == headers_all;
+        }
+
+        bool accept(const clang::SourceManager &sm, const clang::Decl *d) const;
+
+        bool accept_macro(const clang::SourceManager &sm, llvm::StringRef name,
+                          clang::SourceLocation loc) const;
+    };
+
+    // The absolute, normalized path of the file containing loc, or an
+    // empty string for builtins and the like
+    std::string file_path(const clang::SourceManager &sm, clang::SourceLocation loc);
+}
+
+#endif /* C2FFI_FILTER_H */
@@ -0,0 +1,49 @@
+/* -*- c++ -*-
+
+   c2ffi
+   Copyright (C) 2013  Ryan Pavlik
+
+   This file is part of c2ffi.
+
+   c2ffi is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   c2ffi is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef C2FFI_FINGERPRINT_H
+#define C2FFI_FINGERPRINT_H
+
+#include <cstdint>
+#include <memory>
+
+#include "c2ffi.h"
+
+namespace c2ffi {
+    class FingerprintWriter;
+
+    // A 64-bit hash of what a declaration means to a binding: its kind,
+    // name, layout, field and parameter types and function signature.
+    // Where it is declared, and ids which depend on declaration order,
+    // are left out, so it only changes when the declaration does.  One
+    // writer is kept for every declaration hashed.
+    class Fingerprinter {
+        std::unique_ptr<FingerprintWriter> _w;
+
+    public:
+        Fingerprinter();
+        ~Fingerprinter();
+
+        uint64_t operator()(const Decl &d);
+    };
+}
+
+#endif /* C2FFI_FINGERPRINT_H */
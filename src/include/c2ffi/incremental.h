@@ -0,0 +1,112 @@
+/* -*- c++ -*-
+
+   c2ffi
+   Copyright (C) 2013  Ryan Pavlik
+
+   This file is part of c2ffi.
+
+   c2ffi is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   c2ffi is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef C2FFI_INCREMENTAL_H
+#define C2FFI_INCREMENTAL_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <clang/AST/Decl.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Lex/MacroInfo.h>
+#include <clang/Lex/Preprocessor.h>
+
+namespace c2ffi {
+    class C2FFIASTConsumer;
+
+    struct DeferredDecl;
+
+    // Incremental output (--incremental).  Each run of declarations from
+    // one source file is preceded by a SourceFileDecl recording the
+    // file's path and content hash, and a key covering everything the
+    // run was built from: the options, the run's place in its file, and
+    // the contents of every file its declarations refer to, directly or
+    // not, along with the macros each of those uses and where they were
+    // defined.  Given the previous output, a run whose key is unchanged
+    // is copied from it, with its declaration ids renumbered, instead of
+    // being built and written again.
+    class Incremental {
+        class Watcher;
+
+        struct PrevRun {
+            // Old id to the key of what it numbered
+            std::map<unsigned int, std::string> ids;
+            std::vector<std::string> decls;
+        };
+
+        struct FileInfo {
+            std::string path;
+            std::string hash;
+        };
+
+        std::string _options;
+        std::map<std::string, PrevRun> _prev;
+
+        std::map<clang::FileID, FileInfo> _files;
+
+        // Files each file's declarations refer to
+        std::map<clang::FileID, std::set<clang::FileID>> _refs;
+
+        // "name=where defined" for each macro each file uses
+        std::map<clang::FileID, std::set<std::string>> _macros;
+        std::set<std::pair<clang::FileID, const void *>> _macros_seen;
+
+        const FileInfo &file(const clang::SourceManager &sm, clang::FileID fid);
+
+        void use_macro(const clang::SourceManager &sm, clang::SourceLocation loc,
+                       const clang::IdentifierInfo *name,
+                       const clang::MacroInfo *mi);
+
+        void add_refs(const clang::SourceManager &sm,
+                      const std::vector<const DeferredDecl *> &decls);
+
+        std::string run_key(const clang::SourceManager &sm, clang::FileID fid,
+                            const DeferredDecl *const *run, size_t n);
+
+        bool splice(C2FFIASTConsumer &ast, const FileInfo &f,
+                    const std::string &key, const PrevRun &prev,
+                    const DeferredDecl *const *run, size_t n);
+
+        void write_run(C2FFIASTConsumer &ast, clang::FileID fid,
+                       const DeferredDecl *const *run, size_t n);
+
+    public:
+        // options are those deciding what is output; a change to them
+        // changes every key
+        explicit Incremental(std::string options)
+                : _options(std::move(options)) {}
+
+        // A missing previous output is not an error; everything is new
+        void load(const std::string &path);
+
+        // Before parsing, so every macro use is seen
+        void watch(clang::Preprocessor &pp);
+
+        // Writes decls through ast, in order, copying what it can
+        void emit(C2FFIASTConsumer &ast,
+                  const std::vector<const DeferredDecl *> &decls);
+    };
+}
+
+#endif /* C2FFI_INCREMENTAL_H */
@@ -0,0 +1,272 @@
+/* -*- c++ -*-
+
+   c2ffi
+   Copyright (C) 2013  Ryan Pavlik
+
+   This file is part of c2ffi.
+
+   c2ffi is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   c2ffi is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* The mmspec format written by the mmspec driver, and a reader for it.
+   This header is plain C and needs nothing from c2ffi or LLVM, so it
+   can be copied into a binding loader.
+
+   The file is meant to be mapped as it is: a header, then arrays of
+   fixed-size declaration, type and field records, a hash table over
+   declaration names, and a table of NUL-terminated strings.  Records
+   refer to each other by index and to strings by offset into the
+   string table; offset 0 is the empty string.  Everything is in the
+   byte order of the machine that wrote it, which the header records.
+
+   Usage:
+
+       c2ffi_mmspec spec;
+       if (c2ffi_mmspec_open(&spec, data, size) == 0) {
+           const c2ffi_mm_decl *d = c2ffi_mmspec_find(&spec, "foo_create");
+           ...
+       }
+
+   where data is the whole file, typically from mmap(). */
+
+#ifndef C2FFI_MMSPEC_H
+#define C2FFI_MMSPEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define C2FFI_MM_MAGIC "c2ffimm"
+#define C2FFI_MM_VERSION 1
+#define C2FFI_MM_BYTE_ORDER 0x01020304u
+
+/* No type, or an empty hash bucket */
+#define C2FFI_MM_NONE 0xffffffffu
+
+/* c2ffi_mm_decl.kind */
+enum c2ffi_mm_decl_kind {
+    C2FFI_MM_UNHANDLED = 0,
+    C2FFI_MM_CONST,
+    C2FFI_MM_EXTERN,
+    C2FFI_MM_FUNCTION,
+    C2FFI_MM_TYPEDEF,
+    C2FFI_MM_STRUCT,
+    C2FFI_MM_UNION,
+    C2FFI_MM_CLASS,
+    C2FFI_MM_ENUM,
+    C2FFI_MM_NAMESPACE,
+    C2FFI_MM_TYPE_ALIAS,
+    C2FFI_MM_USING,
+    C2FFI_MM_OBJC_INTERFACE,
+    C2FFI_MM_OBJC_CATEGORY,
+    C2FFI_MM_OBJC_PROTOCOL,
+    C2FFI_MM_USING_SHADOW,
+    C2FFI_MM_USING_DIRECTIVE
+};
+
+/* c2ffi_mm_decl.flags.  Alias and variable templates are written as
+   type aliases and variables with C2FFI_MM_TEMPLATE, and --toposort's
+   forward declarations with the kind of what they declare and
+   C2FFI_MM_FORWARD, as an Objective-C @class is. */
+enum c2ffi_mm_decl_flag {
+    C2FFI_MM_VARIADIC = 1 << 0,
+    C2FFI_MM_INLINE = 1 << 1,
+    C2FFI_MM_STRING_VALUE = 1 << 2,
+    C2FFI_MM_FORWARD = 1 << 3,
+    C2FFI_MM_TEMPLATE = 1 << 4
+};
+
+/* c2ffi_mm_type.kind */
+enum c2ffi_mm_type_kind {
+    C2FFI_MM_T_SIMPLE = 0,    /* name: typedef name, ":void", ... */
+    C2FFI_MM_T_BASIC,         /* name: ":int", ":unsigned-char", ... */
+    C2FFI_MM_T_BITFIELD,      /* target: type, size: width */
+    C2FFI_MM_T_POINTER,       /* target: pointee */
+    C2FFI_MM_T_REFERENCE,     /* target: referee */
+    C2FFI_MM_T_ARRAY,         /* target: element, size: length */
+    C2FFI_MM_T_STRUCT,        /* name, id */
+    C2FFI_MM_T_UNION,
+    C2FFI_MM_T_CLASS,
+    C2FFI_MM_T_ENUM,
+    C2FFI_MM_T_DECL           /* target: a declaration written inline */
+};
+
+typedef struct c2ffi_mm_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+
+    uint32_t decl_count;
+    uint32_t type_count;
+    uint32_t field_count;
+    uint32_t bucket_count;    /* a power of two */
+
+    /* File offsets of each section */
+    uint64_t decls;
+    uint64_t types;
+    uint64_t fields;
+    uint64_t buckets;
+    uint64_t strings;
+    uint64_t strings_size;
+} c2ffi_mm_header;
+
+typedef struct c2ffi_mm_decl {
+    uint32_t kind;
+    uint32_t flags;
+    uint32_t name;            /* string */
+    uint32_t location;        /* string */
+    uint32_t value;           /* string: a constant's value */
+    uint32_t ns;
+    uint32_t id;
+
+    /* Variable and typedef type, or function return type */
+    uint32_t type;
+
+    /* Record fields, function parameters or enum constants */
+    uint32_t first_field;
+    uint32_t field_count;
+
+    uint32_t bit_alignment;
+    uint32_t reserved;
+    uint64_t bit_size;
+} c2ffi_mm_decl;
+
+typedef struct c2ffi_mm_type {
+    uint32_t kind;
+    uint32_t name;            /* string */
+    uint32_t target;          /* type or declaration index */
+    uint32_t id;
+    uint64_t size;
+    uint64_t bit_size;
+    uint32_t bit_alignment;
+    uint32_t reserved;
+} c2ffi_mm_type;
+
+typedef struct c2ffi_mm_field {
+    uint32_t name;            /* string */
+    uint32_t type;            /* C2FFI_MM_NONE for enum constants */
+    uint64_t bit_offset;      /* the value, for enum constants */
+    uint64_t bit_size;
+    uint32_t bit_alignment;
+    uint32_t reserved;
+} c2ffi_mm_field;
+
+typedef struct c2ffi_mmspec {
+    const char *base;
+    size_t size;
+    const c2ffi_mm_header *header;
+} c2ffi_mmspec;
+
+/* FNV-1a, which the hash table is built with */
+static inline uint32_t c2ffi_mm_hash(const char *s, size_t n) {
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        h ^= (unsigned char) s[i];
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+static inline int c2ffi_mm_section_ok(const c2ffi_mmspec *s, uint64_t off,
+                                      uint64_t count, uint64_t size) {
+    return off <= s->size && count <= (s->size - off) / size;
+}
+
+/* Returns 0 if data holds a spec this reader understands */
+static inline int c2ffi_mmspec_open(c2ffi_mmspec *s, const void *data, size_t size) {
+    const c2ffi_mm_header *h = (const c2ffi_mm_header *) data;
+
+    s->base = (const char *) data;
+    s->size = size;
+    s->header = h;
+
+    if (size < sizeof(*h) || memcmp(h->magic, C2FFI_MM_MAGIC, 8) != 0)
+        return -1;
+
+    if (h->version != C2FFI_MM_VERSION || h->byte_order != C2FFI_MM_BYTE_ORDER)
+        return -1;
+
+    if (!c2ffi_mm_section_ok(s, h->decls, h->decl_count, sizeof(c2ffi_mm_decl)) ||
+        !c2ffi_mm_section_ok(s, h->types, h->type_count, sizeof(c2ffi_mm_type)) ||
+        !c2ffi_mm_section_ok(s, h->fields, h->field_count, sizeof(c2ffi_mm_field)) ||
+        !c2ffi_mm_section_ok(s, h->buckets, h->bucket_count, sizeof(uint32_t)) ||
+        !c2ffi_mm_section_ok(s, h->strings, h->strings_size, 1) ||
+        h->strings_size == 0 || s->base[h->strings + h->strings_size - 1] != '\0')
+        return -1;
+
+    return 0;
+}
+
+static inline const char *c2ffi_mmspec_string(const c2ffi_mmspec *s, uint32_t off) {
+    return off < s->header->strings_size ? s->base + s->header->strings + off : "";
+}
+
+static inline const c2ffi_mm_decl *c2ffi_mmspec_decl(const c2ffi_mmspec *s, uint32_t i) {
+    return i < s->header->decl_count
+           ? (const c2ffi_mm_decl *) (s->base + s->header->decls) + i : NULL;
+}
+
+static inline const c2ffi_mm_type *c2ffi_mmspec_type(const c2ffi_mmspec *s, uint32_t i) {
+    return i < s->header->type_count
+           ? (const c2ffi_mm_type *) (s->base + s->header->types) + i : NULL;
+}
+
+static inline const c2ffi_mm_field *c2ffi_mmspec_field(const c2ffi_mmspec *s, uint32_t i) {
+    return i < s->header->field_count
+           ? (const c2ffi_mm_field *) (s->base + s->header->fields) + i : NULL;
+}
+
+/* The first declaration named name after prev (NULL to start), or NULL.
+   C allows a struct and a function to share a name, and redeclarations
+   appear more than once, so a name may have several. */
+static inline const c2ffi_mm_decl *c2ffi_mmspec_find_next(const c2ffi_mmspec *s,
+                                                          const char *name,
+                                                          const c2ffi_mm_decl *prev) {
+    const c2ffi_mm_header *h = s->header;
+    const uint32_t *buckets = (const uint32_t *) (s->base + h->buckets);
+    const c2ffi_mm_decl *decls = (const c2ffi_mm_decl *) (s->base + h->decls);
+    size_t n = strlen(name);
+    uint32_t mask, i, probes;
+    int seen = prev == NULL;
+
+    if (!h->bucket_count) return NULL;
+
+    mask = h->bucket_count - 1;
+    i = c2ffi_mm_hash(name, n) & mask;
+
+    for (probes = 0; probes < h->bucket_count; probes++, i = (i + 1) & mask) {
+        uint32_t d = buckets[i];
+
+        if (d == C2FFI_MM_NONE) return NULL;
+        if (d >= h->decl_count) continue;
+
+        if (strcmp(c2ffi_mmspec_string(s, decls[d].name), name) != 0)
+            continue;
+
+        if (seen) return &decls[d];
+        if (&decls[d] == prev) seen = 1;
+    }
+
+    return NULL;
+}
+
+static inline const c2ffi_mm_decl *c2ffi_mmspec_find(const c2ffi_mmspec *s,
+                                                     const char *name) {
+    return c2ffi_mmspec_find_next(s, name, NULL);
+}
+
+#endif /* C2FFI_MMSPEC_H */
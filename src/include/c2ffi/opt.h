@@ -30,25 +30,78 @@
 #include <fstream>
 
 #include "c2ffi.h"
+#include "c2ffi/compress.h"
+#include "c2ffi/filter.h"
+#include "c2ffi/incremental.h"
 
 namespace c2ffi {
     typedef std::vector<std::string> IncludeVector;
 
+    /* Declaration kinds selectable with --kinds */
+    enum decl_kind {
+        kind_function = 1 << 0,
+        kind_var = 1 << 1,
+        kind_struct = 1 << 2,
+        kind_enum = 1 << 3,
+        kind_typedef = 1 << 4,
+        kind_type_alias = 1 << 5,
+        kind_namespace = 1 << 6,
+        kind_using = 1 << 7,
+        kind_objc = 1 << 8,
+        kind_unhandled = 1 << 9,
+        kind_union = 1 << 10,
+        kind_class = 1 << 11,
+
+        kind_record = kind_struct | kind_union | kind_class,
+        kind_all = (1 << 12) - 1
+    };
+
+    /* What --usr adds to declarations and type references */
+    enum usr_mode {
+        usr_none,
+        usr_full,
+        usr_hash
+    };
+
     struct config {
-        config() : od(nullptr), macro_output(nullptr),
+        config() : od(nullptr), base_od(nullptr), macro_output(nullptr),
                    template_output(nullptr),
+                   deps_output(nullptr),
+                   compressed(nullptr),
+                   base_compressed(nullptr),
+                   incremental(nullptr),
                    std(clang::LangStandard::lang_unspecified),
+                   decl_kinds(kind_all),
+                   usr(usr_none),
                    preprocess_only(false),
-                   with_macro_defs(false) {}
+                   with_macro_defs(false),
+                   async_output(false),
+                   fingerprints(false),
+                   toposort(false) {}
 
         IncludeVector includes;
         IncludeVector sys_includes;
         IncludeVector framework_includes;
         OutputDriver *od;
 
+        // --base-spec writes system declarations to base_od instead,
+        // --use-base-spec leaves them out; either way the output refers
+        // to base_spec
+        OutputDriver *base_od;
+        std::string base_spec;
+
         std::ostream *output{};
         std::ofstream *macro_output;
         std::ofstream *template_output;
+        std::ofstream *deps_output;
+
+        // output, when it is compressed (--compress); finished last
+        CompressStream *compressed;
+
+        // The same for base_od
+        CompressStream *base_compressed;
+
+        Incremental *incremental;
 
         std::string filename;
         std::string to_namespace;
@@ -57,8 +110,17 @@ namespace c2ffi {
         clang::LangStandard::Kind std;
         std::string arch;
 
+        unsigned int decl_kinds;
+        DeclFilter filter;
+        std::vector<llvm::GlobPattern> roots;
+
+        usr_mode usr;
+
         bool preprocess_only;
         bool with_macro_defs;
+        bool async_output;
+        bool fingerprints;
+        bool toposort;
     };
 
     void process_args(config &config, int argc, char *argv[]);
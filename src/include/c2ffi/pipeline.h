@@ -0,0 +1,131 @@
+/* -*- c++ -*-
+
+   c2ffi
+   Copyright (C) 2013  Ryan Pavlik
+
+   This file is part of c2ffi.
+
+   c2ffi is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   c2ffi is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef C2FFI_PIPELINE_H
+#define C2FFI_PIPELINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "c2ffi/predecl.h"
+
+namespace c2ffi {
+    class OutputDriver;
+
+    // Bounded lock-free queue for exactly one producer and one consumer
+    template<typename T>
+    class SPSCQueue {
+        std::vector<T> _buf;
+        size_t _mask;
+
+        // Written by the consumer only
+        std::atomic<size_t> _head;
+        // Written by the producer only
+        std::atomic<size_t> _tail;
+
+    public:
+        // The capacity is rounded up to a power of two
+        explicit SPSCQueue(size_t capacity)
+                : _mask(0), _head(0), _tail(0) {
+            size_t n = 1;
+            while (n < capacity) n <<= 1;
+
+            _buf.resize(n);
+            _mask = n - 1;
+        }
+
+        bool try_push(const T &v) {
+            size_t tail = _tail.load(std::memory_order_relaxed);
+
+            if (tail - _head.load(std::memory_order_acquire) == _buf.size())
+                return false;
+
+            _buf[tail & _mask] = v;
+            _tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        // Either side may ask; the answer may be out of date by the
+        // time it is used
+        bool empty() const {
+            return _head.load(std::memory_order_acquire)
+                   == _tail.load(std::memory_order_acquire);
+        }
+
+        bool full() const {
+            return _tail.load(std::memory_order_acquire)
+                   - _head.load(std::memory_order_acquire) == _buf.size();
+        }
+
+        bool try_pop(T &v) {
+            size_t head = _head.load(std::memory_order_relaxed);
+
+            if (head == _tail.load(std::memory_order_acquire))
+                return false;
+
+            v = _buf[head & _mask];
+            _head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+    };
+
+    // Hands finished declarations from the parser thread to a
+    // serializer thread which owns the OutputDriver (and its stream)
+    // until finish().  Declarations are written, in the order they were
+    // pushed, with write_between() separating them.  A side which has to
+    // wait spins briefly, then sleeps until the other wakes it.
+    class DeclPipeline {
+        OutputDriver &_od;
+        SPSCQueue<Decl *> _queue;
+        std::thread _thread;
+
+        // Only one side can be waiting at a time: the queue can't be
+        // both empty and full
+        std::mutex _mutex;
+        std::condition_variable _cv;
+        std::atomic<bool> _sleeping;
+
+        void run();
+
+        template<typename Ready>
+        void wait(Ready ready);
+
+        void wake();
+
+    public:
+        DeclPipeline(OutputDriver &od, size_t capacity = 4096)
+                : _od(od), _queue(capacity), _sleeping(false) {}
+
+        void start();
+
+        // Takes ownership of d
+        void push(Decl *d);
+
+        // Drains the queue and joins the serializer thread
+        void finish();
+    };
+}
+
+#endif /* C2FFI_PIPELINE_H */
@@ -84,5 +84,11 @@ namespace c2ffi {
     class ObjCCategoryDecl;
 
     class ObjCProtocolDecl;
+
+    class SourceFileDecl;
+
+    class RawDecl;
+
+    class ForwardDecl;
 }
 #endif /* C2FFI_PREDECL_H */
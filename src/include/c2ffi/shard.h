@@ -0,0 +1,38 @@
+/* -*- c++ -*-
+
+   c2ffi
+   Copyright (C) 2013  Ryan Pavlik
+
+   This file is part of c2ffi.
+
+   c2ffi is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   c2ffi is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef C2FFI_SHARD_H
+#define C2FFI_SHARD_H
+
+#include <string>
+
+#include "c2ffi/driver.h"
+
+namespace c2ffi {
+    /* --shard-by-file: each declaration goes to a file in dir named
+       after the header it was declared in, written by a driver made
+       with make.  dir/manifest.json lists which header went where. */
+    OutputDriver *MakeShardOutputDriver(const std::string &dir,
+                                        const std::string &driver,
+                                        MakeOutputDriver make);
+}
+
+#endif /* C2FFI_SHARD_H */
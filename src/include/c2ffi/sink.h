@@ -0,0 +1,144 @@
+/* -*- c++ -*-
+
+   c2ffi
+   Copyright (C) 2013  Ryan Pavlik
+
+   This file is part of c2ffi.
+
+   c2ffi is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   c2ffi is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef C2FFI_SINK_H
+#define C2FFI_SINK_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include <llvm/ADT/StringRef.h>
+
+namespace c2ffi {
+    /* Where drivers write their output.  Output is collected in a
+       buffer which is only handed to the stream when it fills up, or
+       on flush(), and numbers are formatted without going through
+       iostreams.  Nothing is flushed between declarations.  The
+       buffer is only allocated once something is written, so sinks
+       which never are cost nothing.  A sink with no stream drops what
+       it is given. */
+    class OutputSink {
+        std::ostream *_os;
+        std::unique_ptr<char[]> _buf;
+        size_t _size;
+        size_t _len;
+        uint64_t _written;
+
+        void drain();
+
+        // Drains, allocating the buffer if there is none yet
+        void make_room();
+
+        OutputSink &write_unsigned(unsigned long long v, bool negative);
+
+    public:
+        static const size_t capacity = 1 << 16;
+
+        explicit OutputSink(std::ostream *os)
+                : _os(os), _size(0), _len(0), _written(0) {}
+
+        OutputSink(const OutputSink &) = delete;
+
+        OutputSink &operator=(const OutputSink &) = delete;
+
+        ~OutputSink() { drain(); }
+
+        // Anything already written goes to the old stream first
+        void set_os(std::ostream *os) {
+            drain();
+            _os = os;
+        }
+
+        std::ostream *stream() const { return _os; }
+
+        // Bytes written so far, buffered or not
+        uint64_t tell() const { return _written + _len; }
+
+        // Hands the buffer to the stream and flushes that
+        void flush();
+
+        void write(const char *s, size_t n) {
+            if (!n) return;
+
+            if (n > _size - _len) {
+                if (n >= capacity) {
+                    drain();
+                    if (_os) _os->write(s, n);
+                    _written += n;
+                    return;
+                }
+
+                make_room();
+            }
+
+            memcpy(_buf.get() + _len, s, n);
+            _len += n;
+        }
+
+        void put(char c) {
+            if (_len == _size) make_room();
+            _buf[_len++] = c;
+        }
+
+        OutputSink &operator<<(char c) {
+            put(c);
+            return *this;
+        }
+
+        OutputSink &operator<<(const char *s) {
+            write(s, strlen(s));
+            return *this;
+        }
+
+        OutputSink &operator<<(const std::string &s) {
+            write(s.data(), s.size());
+            return *this;
+        }
+
+        OutputSink &operator<<(llvm::StringRef s) {
+            write(s.data(), s.size());
+            return *this;
+        }
+
+        OutputSink &operator<<(int v) { return *this << (long long) v; }
+
+        OutputSink &operator<<(long v) { return *this << (long long) v; }
+
+        OutputSink &operator<<(long long v) {
+            return v < 0 ? write_unsigned(0ULL - (unsigned long long) v, true)
+                         : write_unsigned(v, false);
+        }
+
+        OutputSink &operator<<(unsigned int v) { return write_unsigned(v, false); }
+
+        OutputSink &operator<<(unsigned long v) { return write_unsigned(v, false); }
+
+        OutputSink &operator<<(unsigned long long v) { return write_unsigned(v, false); }
+
+        // As iostreams would by default: %g, 6 significant digits
+        OutputSink &operator<<(double v);
+    };
+}
+
+#endif /* C2FFI_SINK_H */
@@ -0,0 +1,62 @@
+/* -*- c++ -*-
+
+   c2ffi
+   Copyright (C) 2013  Ryan Pavlik
+
+   This file is part of c2ffi.
+
+   c2ffi is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   c2ffi is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef C2FFI_SPEC_H
+#define C2FFI_SPEC_H
+
+#include <fstream>
+#include <string>
+
+#include <llvm/ADT/StringRef.h>
+
+namespace c2ffi {
+    // Reads output of the json or ndjson driver back one top-level
+    // object at a time.  Both write every top-level object on a line of
+    // its own, so no JSON needs to be parsed to split them.
+    class SpecReader {
+        std::ifstream _in;
+
+    public:
+        explicit SpecReader(const std::string &path) : _in(path) {}
+
+        bool is_open() const { return _in.is_open(); }
+
+        // The text of the next object, without separators
+        bool next(std::string &text);
+    };
+
+    // The "tag" of an object as written by the json driver, found
+    // without parsing the rest of it
+    llvm::StringRef spec_tag(llvm::StringRef text);
+
+    // The first string value for key, still escaped.  The json driver
+    // writes "name" and "location" before anything nested, so for
+    // those this is the object's own.
+    llvm::StringRef spec_string(llvm::StringRef text, llvm::StringRef key);
+
+    // c2ffi diff OLD NEW
+    int spec_diff(int argc, char *argv[]);
+
+    // c2ffi merge [-o OUTPUT] INPUT...
+    int spec_merge(int argc, char *argv[]);
+}
+
+#endif /* C2FFI_SPEC_H */
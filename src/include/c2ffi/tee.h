@@ -0,0 +1,47 @@
+/* -*- c++ -*-
+
+   c2ffi
+   Copyright (C) 2013  Ryan Pavlik
+
+   This file is part of c2ffi.
+
+   c2ffi is free software: you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation, either version 2 of the License, or
+   (at your option) any later version.
+
+   c2ffi is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with c2ffi.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef C2FFI_TEE_H
+#define C2FFI_TEE_H
+
+#include <string>
+#include <vector>
+
+#include "c2ffi/driver.h"
+
+namespace c2ffi {
+    /* -D driver=path: one more output, written by the named driver to
+       path, compressed if its extension asks for it. */
+    struct TeeOutput {
+        std::string path;
+        MakeOutputDriver make;
+    };
+
+    typedef std::vector<TeeOutput> TeeOutputVector;
+
+    /* Everything written to the returned driver goes to primary, if
+       not null, and to each of outputs, so one parse produces them
+       all; declarations are built once and shared between them. */
+    OutputDriver *MakeTeeOutputDriver(OutputDriver *primary,
+                                      const TeeOutputVector &outputs);
+}
+
+#endif /* C2FFI_TEE_H */
@@ -84,12 +84,19 @@ namespace c2ffi {
     // :void, typedef names, etc
     class SimpleType : public Type {
         std::string _name;
+        std::string _usr;
     public:
         SimpleType(const clang::CompilerInstance &ci, const clang::Type *t,
                    std::string name);
 
         const std::string &name() const { return _name; }
 
+        // Of the declaration a typedef, record or enum type refers to;
+        // empty unless --usr was given
+        const std::string &usr() const { return _usr; }
+
+        void set_usr(std::string usr) { _usr = std::move(usr); }
+
         DEFWRITER(SimpleType);
     };
 
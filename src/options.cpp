@@ -20,19 +20,42 @@
 */
 
 #include <climits>
+#include <cstring>
 
 #include <getopt.h>
 #include <sys/stat.h>
 
+#include <llvm/Support/Error.h>
 #include <llvm/Support/Host.h>
 
 #include "c2ffi.h"
 #include "c2ffi/opt.h"
+#include "c2ffi/shard.h"
+#include "c2ffi/tee.h"
 
 static char short_opt[] = "I:i:F:D:M:o:hN:x:A:T:E";
 
 enum {
     WITH_MACRO_DEFS = CHAR_MAX + 1,
+    KINDS,
+    ASYNC,
+    ONLY_FROM,
+    NAME,
+    NAME_PREFIX,
+    HEADERS,
+    ROOTS,
+    INCREMENTAL,
+    BASE_SPEC,
+    USE_BASE_SPEC,
+    USR,
+    FINGERPRINTS,
+    INDEX,
+    COMPRESS,
+    SHARD_BY_FILE,
+    TYPE_TABLE,
+    FILE_TABLE,
+    TOPOSORT,
+    DEPS,
 };
 
 static struct option options[] = {
@@ -49,11 +72,81 @@ static struct option options[] = {
         {"templates",         required_argument, nullptr, 'T'},
         {"std",               required_argument, nullptr, 'S'},
         {"with-macro-defs",   no_argument,       nullptr, WITH_MACRO_DEFS},
+        {"kinds",             required_argument, nullptr, KINDS},
+        {"async",             no_argument,       nullptr, ASYNC},
+        {"only-from",         required_argument, nullptr, ONLY_FROM},
+        {"name",              required_argument, nullptr, NAME},
+        {"name-prefix",       required_argument, nullptr, NAME_PREFIX},
+        {"headers",           required_argument, nullptr, HEADERS},
+        {"roots",             required_argument, nullptr, ROOTS},
+        {"incremental",       required_argument, nullptr, INCREMENTAL},
+        {"base-spec",         required_argument, nullptr, BASE_SPEC},
+        {"use-base-spec",     required_argument, nullptr, USE_BASE_SPEC},
+        {"usr",               optional_argument, nullptr, USR},
+        {"fingerprints",      no_argument,       nullptr, FINGERPRINTS},
+        {"index",             required_argument, nullptr, INDEX},
+        {"compress",          required_argument, nullptr, COMPRESS},
+        {"shard-by-file",     required_argument, nullptr, SHARD_BY_FILE},
+        {"type-table",        no_argument,       nullptr, TYPE_TABLE},
+        {"file-table",        no_argument,       nullptr, FILE_TABLE},
+        {"toposort",          no_argument,       nullptr, TOPOSORT},
+        {"deps",              required_argument, nullptr, DEPS},
         {nullptr, 0,                             nullptr, 0}
 };
 
+static struct {
+    const char *name;
+    unsigned int mask;
+} kind_names[] = {
+        {"function",   c2ffi::kind_function},
+        {"var",        c2ffi::kind_var},
+        {"struct",     c2ffi::kind_struct},
+        {"union",      c2ffi::kind_union},
+        {"class",      c2ffi::kind_class},
+        {"enum",       c2ffi::kind_enum},
+        {"typedef",    c2ffi::kind_typedef},
+        {"type-alias", c2ffi::kind_type_alias},
+        {"namespace",  c2ffi::kind_namespace},
+        {"using",      c2ffi::kind_using},
+        {"objc",       c2ffi::kind_objc},
+        {"unhandled",  c2ffi::kind_unhandled},
+        {"all",        c2ffi::kind_all},
+        {nullptr,      0}
+};
+
 static void usage();
 
+static c2ffi::MakeOutputDriver find_driver(const std::string &name);
+
+// Whether an option changes what declarations are output, or how;
+// --incremental only copies what was output with the same
+static bool shapes_output(int o) {
+    switch (o) {
+        case 'I':
+        case 'i':
+        case 'F':
+        case 'D':
+        case 'N':
+        case 'x':
+        case 'A':
+        case 'S':
+        case KINDS:
+        case ONLY_FROM:
+        case NAME:
+        case NAME_PREFIX:
+        case HEADERS:
+        case ROOTS:
+        case BASE_SPEC:
+        case USE_BASE_SPEC:
+        case USR:
+        case FINGERPRINTS:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
 static c2ffi::OutputDriver *select_driver(const std::string &name, std::ostream *os);
 
 clang::InputKind parseLang(const std::string &str) {
@@ -81,6 +174,33 @@ clang::LangStandard::Kind parseStd(const std::string &std) {
 
 #pragma clang diagnostic pop
 
+unsigned int parseKinds(const std::string &str) {
+    unsigned int mask = 0;
+    size_t start = 0;
+
+    while (start <= str.size()) {
+        size_t end = str.find(',', start);
+        if (end == std::string::npos) end = str.size();
+
+        std::string name = str.substr(start, end - start);
+        int i;
+
+        for (i = 0; kind_names[i].name; i++)
+            if (name == kind_names[i].name) break;
+
+        if (!kind_names[i].name) {
+            std::cerr << "Error: unknown declaration kind specified, --kinds="
+                      << name << std::endl;
+            exit(1);
+        }
+
+        mask |= kind_names[i].mask;
+        start = end + 1;
+    }
+
+    return mask;
+}
+
 clang::InputKind parseExtension(const std::string &file) {
     using namespace clang;
     using Language = InputKind::Language;
@@ -104,6 +224,19 @@ void c2ffi::process_args(config &config, int argc, char *argv[]) {
     int o, index;
     bool output_specified = false;
     std::ostream *os = &std::cout;
+    std::ofstream *output_file = nullptr;
+    std::string output_path;
+    std::string driver_name = OutputDrivers[0].name;
+    std::string incremental_path;
+    std::string options_key;
+    std::string index_path;
+    std::string shard_dir;
+    TeeOutputVector tees;
+    compress_mode compress = compress_none;
+    bool compress_specified = false;
+    bool write_base = false;
+    bool type_table = false;
+    bool file_table = false;
 
     for (;;) {
         o = getopt_long(argc, argv, short_opt, options, &index);
@@ -111,6 +244,11 @@ void c2ffi::process_args(config &config, int argc, char *argv[]) {
         if (o == -1)
             break;
 
+        if (shapes_output(o)) {
+            options_key += std::to_string(o) + "=" + (optarg ? optarg : "");
+            options_key += '\0';
+        }
+
         switch (o) {
             case 'M': {
                 if (config.macro_output) {
@@ -132,9 +270,11 @@ void c2ffi::process_args(config &config, int argc, char *argv[]) {
                     exit(1);
                 }
 
-                auto *of = new std::ofstream;
-                of->open(optarg);
-                os = of;
+                // Opened once all options are read, as it may also be
+                // the --incremental input
+                output_file = new std::ofstream;
+                output_path = optarg;
+                os = output_file;
                 output_specified = true;
                 break;
             }
@@ -151,14 +291,25 @@ void c2ffi::process_args(config &config, int argc, char *argv[]) {
                 config.sys_includes.push_back(optarg);
                 break;
 
-            case 'D':
+            case 'D': {
+                // driver=path adds an output rather than choosing one
+                const char *eq = strchr(optarg, '=');
+
+                if (eq) {
+                    std::string name(optarg, eq - optarg);
+                    tees.push_back({eq + 1, find_driver(name)});
+                    break;
+                }
+
                 if (config.od) {
                     std::cerr << "Error: you may only specify one output driver"
                               << std::endl;
                     exit(1);
                 }
                 config.od = select_driver(optarg, os);
+                driver_name = optarg;
                 break;
+            }
 
             case 'N':
                 config.to_namespace = optarg;
@@ -200,6 +351,145 @@ void c2ffi::process_args(config &config, int argc, char *argv[]) {
                 config.with_macro_defs = true;
                 break;
 
+            case KINDS:
+                config.decl_kinds = parseKinds(optarg);
+                break;
+
+            case ASYNC:
+                config.async_output = true;
+                break;
+
+            case ONLY_FROM: {
+                std::string error;
+
+                if (!config.filter.add_file_glob(optarg, error)) {
+                    std::cerr << "Error: invalid pattern, --only-from="
+                              << optarg << ": " << error << std::endl;
+                    exit(1);
+                }
+                break;
+            }
+
+            case NAME: {
+                std::string error;
+
+                if (!config.filter.add_name_regex(optarg, error)) {
+                    std::cerr << "Error: invalid regular expression, --name="
+                              << optarg << ": " << error << std::endl;
+                    exit(1);
+                }
+                break;
+            }
+
+            case NAME_PREFIX:
+                config.filter.add_name_prefix(optarg);
+                break;
+
+            case HEADERS:
+                if (std::string(optarg) == "all")
+                    config.filter.set_headers(DeclFilter::headers_all);
+                else if (std::string(optarg) == "user")
+                    config.filter.set_headers(DeclFilter::headers_user);
+                else if (std::string(optarg) == "system")
+                    config.filter.set_headers(DeclFilter::headers_system);
+                else {
+                    std::cerr << "Error: unknown header class, --headers="
+                              << optarg << std::endl;
+                    exit(1);
+                }
+                break;
+
+            case INCREMENTAL:
+                incremental_path = optarg;
+                break;
+
+            case BASE_SPEC:
+            case USE_BASE_SPEC:
+                if (!config.base_spec.empty()) {
+                    std::cerr << "Error: you may only specify one base spec"
+                              << std::endl;
+                    exit(1);
+                }
+
+                config.base_spec = optarg;
+                write_base = (o == BASE_SPEC);
+                break;
+
+            case USR:
+                if (!optarg || std::string(optarg) == "full")
+                    config.usr = usr_full;
+                else if (std::string(optarg) == "hash")
+                    config.usr = usr_hash;
+                else {
+                    std::cerr << "Error: unknown USR form, --usr="
+                              << optarg << std::endl;
+                    exit(1);
+                }
+                break;
+
+            case FINGERPRINTS:
+                config.fingerprints = true;
+                break;
+
+            case INDEX:
+                index_path = optarg;
+                break;
+
+            case COMPRESS:
+                if (!parse_compress_mode(optarg, compress)) {
+                    std::cerr << "Error: unknown compression, --compress="
+                              << optarg << std::endl;
+                    exit(1);
+                }
+
+                compress_specified = true;
+                break;
+
+            case SHARD_BY_FILE:
+                shard_dir = optarg;
+                break;
+
+            case TYPE_TABLE:
+                type_table = true;
+                break;
+
+            case FILE_TABLE:
+                file_table = true;
+                break;
+
+            case TOPOSORT:
+                config.toposort = true;
+                break;
+
+            case DEPS:
+                if (config.deps_output) {
+                    std::cerr << "Error: You may only specify one dependency file"
+                              << std::endl;
+                    exit(1);
+                }
+
+                config.deps_output = new std::ofstream(optarg);
+
+                if (!config.deps_output->is_open()) {
+                    std::cerr << "Error: cannot write " << optarg << std::endl;
+                    exit(1);
+                }
+                break;
+
+            case ROOTS: {
+                llvm::Expected<llvm::GlobPattern> pat = llvm::GlobPattern::create(optarg);
+
+                if (!pat) {
+                    std::cerr << "Error: invalid pattern, --roots="
+                              << optarg << ": " << llvm::toString(pat.takeError())
+                              << std::endl;
+                    exit(1);
+                }
+
+                config.roots.push_back(*pat);
+                break;
+            }
+
             case 'h':
                 usage();
                 exit(0);
@@ -232,12 +522,196 @@ void c2ffi::process_args(config &config, int argc, char *argv[]) {
         exit(1);
     }
 
+    // The input file's directory and -I paths are user headers
+    std::string dir = config.filename.substr(0, config.filename.find_last_of("/\\") + 1);
+    config.filter.add_user_root(dir.empty() ? "." : dir);
+
+    for (auto &&include : config.includes)
+        config.filter.add_user_root(include);
+
+    // Ids are numbered afresh each run, so only USRs lead into a base
+    // spec written by another
+    if (!config.base_spec.empty() && !write_base && config.usr == usr_none) {
+        std::cerr << "Error: --use-base-spec requires --usr" << std::endl;
+        exit(1);
+    }
+
+    if (!incremental_path.empty()) {
+        if (driver_name != "json" && driver_name != "ndjson") {
+            std::cerr << "Error: --incremental requires the json or ndjson driver"
+                      << std::endl;
+            exit(1);
+        }
+
+        if (compress_mode_for(incremental_path) != compress_none) {
+            std::cerr << "Error: --incremental cannot read compressed output"
+                      << std::endl;
+            exit(1);
+        }
+
+        // Copied declarations are json text
+        if (!tees.empty()) {
+            std::cerr << "Error: -D driver=path cannot be used with --incremental"
+                      << std::endl;
+            exit(1);
+        }
+
+        // It relies on each file's declarations coming together
+        if (config.toposort) {
+            std::cerr << "Error: --toposort cannot be used with --incremental"
+                      << std::endl;
+            exit(1);
+        }
+
+        config.incremental = new Incremental(options_key);
+        config.incremental->load(incremental_path);
+    }
+
+    // Unless given, compression follows the output file's extension
+    if (!compress_specified)
+        compress = compress_mode_for(output_path);
+
+    if (output_file) {
+        output_file->open(output_path, compress != compress_none
+                                       ? std::ios::out | std::ios::binary
+                                       : std::ios::out);
+    }
+
+    if (compress != compress_none) {
+        config.compressed = CompressStream::make(os, compress);
+
+        if (!config.compressed) {
+            std::cerr << "Error: this c2ffi was built without support for "
+                      << "that compression" << std::endl;
+            exit(1);
+        }
+
+        os = config.compressed;
+    }
+
+    if (write_base) {
+        compress_mode base_compress = compress_specified
+                                      ? compress
+                                      : compress_mode_for(config.base_spec);
+        auto *base = new std::ofstream(config.base_spec,
+                                       base_compress != compress_none
+                                       ? std::ios::out | std::ios::binary
+                                       : std::ios::out);
+        std::ostream *base_os = base;
+
+        if (!base->is_open()) {
+            std::cerr << "Error: cannot write base spec " << config.base_spec
+                      << std::endl;
+            exit(1);
+        }
+
+        if (base_compress != compress_none) {
+            config.base_compressed = CompressStream::make(base, base_compress);
+
+            if (!config.base_compressed) {
+                std::cerr << "Error: this c2ffi was built without support for "
+                          << "that compression" << std::endl;
+                exit(1);
+            }
+
+            base_os = config.base_compressed;
+        }
+
+        config.base_od = select_driver(driver_name, base_os);
+    }
+
     config.output = os;
 
+    // With only driver=path outputs, nothing goes to stdout
+    bool primary = config.od || output_specified || compress_specified
+                   || tees.empty();
+
     if (!config.od)
         config.od = OutputDrivers[0].fn(os);
     else
         config.od->set_os(os);
+
+    if (!tees.empty()) {
+        if (!shard_dir.empty()) {
+            std::cerr << "Error: --shard-by-file cannot be used with "
+                      << "-D driver=path" << std::endl;
+            exit(1);
+        }
+
+        if (!primary) {
+            delete config.od;
+            config.od = nullptr;
+        }
+
+        config.od = MakeTeeOutputDriver(config.od, tees);
+    }
+
+    if (type_table) {
+        // Copied declarations would refer to the old spec's type ids
+        if (!incremental_path.empty()) {
+            std::cerr << "Error: --type-table cannot be used with --incremental"
+                      << std::endl;
+            exit(1);
+        }
+
+        if (!config.od->set_type_table()
+            || (config.base_od && !config.base_od->set_type_table())) {
+            std::cerr << "Error: --type-table requires the json, ndjson or sexp driver"
+                      << std::endl;
+            exit(1);
+        }
+    }
+
+    if (file_table) {
+        // ... and to its file numbers
+        if (!incremental_path.empty()) {
+            std::cerr << "Error: --file-table cannot be used with --incremental"
+                      << std::endl;
+            exit(1);
+        }
+
+        if (!config.od->set_file_table()
+            || (config.base_od && !config.base_od->set_file_table())) {
+            std::cerr << "Error: --file-table requires the json or ndjson driver"
+                      << std::endl;
+            exit(1);
+        }
+    }
+
+    if (!shard_dir.empty()) {
+        if (output_specified || compress_specified || !index_path.empty()
+            || !incremental_path.empty()) {
+            std::cerr << "Error: --shard-by-file cannot be used with -o, "
+                      << "--compress, --index or --incremental" << std::endl;
+            exit(1);
+        }
+
+        delete config.od;
+        config.od = MakeShardOutputDriver(shard_dir, driver_name,
+                                          find_driver(driver_name));
+
+        if (type_table)
+            config.od->set_type_table();
+
+        if (file_table)
+            config.od->set_file_table();
+    }
+
+    if (!index_path.empty()) {
+        auto *index = new std::ofstream(index_path);
+
+        if (!index->is_open()) {
+            std::cerr << "Error: cannot write index " << index_path
+                      << std::endl;
+            exit(1);
+        }
+
+        if (!config.od->set_index(index)) {
+            std::cerr << "Error: --index requires the json or ndjson driver"
+                      << std::endl;
+            exit(1);
+        }
+    }
 }
 
 void usage() {
@@ -246,6 +720,8 @@ void usage() {
 
     cout <<
          "Usage: c2ffi [options ...] FILE\n"
+         "       c2ffi diff OLD NEW\n"
+         "       c2ffi merge [-o OUTPUT] INPUT...\n"
          "\n"
          "Options:\n"
          "      -I, --include            Add a \"LOCAL\" include path\n"
@@ -253,7 +729,10 @@ void usage() {
          "      -F, --framework-include  Add MacOS framework include path\n"
          "      -D, --driver             Specify an output driver (default: "
          << OutputDrivers[0].name <<
-         ")\n\n"
+         ")\n"
+         "      -D DRIVER=PATH           Also write output with DRIVER to PATH (may be\n"
+         "                                    given more than once; without -D DRIVER\n"
+         "                                    or -o, nothing goes to stdout)\n\n"
          "      -o, --output             Specify an output file (default: stdout)\n"
          "      -M, --macro-file         Specify a file for macro definition output\n"
          "      --with-macro-defs        Also include #defines for macro definitions\n\n"
@@ -264,7 +743,44 @@ void usage() {
          ")\n"
          "      -x, --lang               Specify language (c, c++, objc, objc++)\n"
          "      --std                    Specify the standard (c99, c++0x, c++11, ...)\n\n"
+         "      --kinds                  Only output the given declaration kinds,\n"
+         "                                    comma-separated (default: all)\n"
+         "      --only-from              Only output declarations from files matching\n"
+         "                                    a glob (may be given more than once)\n"
+         "      --name                   Only output names matching a regular expression\n"
+         "      --name-prefix            Only output names starting with a prefix\n"
+         "      --headers                Only output declarations from user or system\n"
+         "                                    headers (user, system, all)\n"
+         "      --roots                  Only output declarations whose names match a\n"
+         "                                    glob, and everything they refer to\n\n"
+         "      --incremental            Copy declarations built from unchanged sources\n"
+         "                                    and options from this previous output\n\n"
+         "      --usr[=full|hash]        Add clang USRs to declarations and type\n"
+         "                                    references, or a 64-bit hash of them\n"
+         "      --fingerprints           Add a hash of each declaration's contents,\n"
+         "                                    which changes only when they do\n"
+         "      --index                  Write the byte offset, length, name, tag and\n"
+         "                                    file of each declaration to this file\n\n"
+         "      --compress               Compress output (gzip, zlib, zstd, none;\n"
+         "                                    default: from -o, .gz or .zst)\n\n"
+         "      --deps                   Write each declaration's name, kind and file,\n"
+         "                                    and those of what it refers to, to this file\n"
+         "      --toposort               Write declarations after everything they refer\n"
+         "                                    to, forward declaring where cycles need it\n\n"
+         "      --type-table             Write each distinct type once, and refer to\n"
+         "                                    it by id everywhere it is used\n"
+         "      --file-table             Write each source file once, and give\n"
+         "                                    locations as its id, a line and a column\n\n"
+         "      --shard-by-file          Write each header's declarations to a file of\n"
+         "                                    its own in this directory, with a manifest\n\n"
+         "      --base-spec              Write system header declarations to this file\n"
+         "                                    instead, and refer to it from the output\n"
+         "      --use-base-spec          Leave system header declarations out, and refer\n"
+         "                                    to this previously written base spec by\n"
+         "                                    USR; requires --usr, and a base spec\n"
+         "                                    written with it\n\n"
          "      -E                       Preprocessed output only, a la clang -E\n\n"
+         "      --async                  Write output on a separate thread while parsing\n\n"
          "Drivers: ";
     for (int i = 0;; i++) {
         if (!OutputDrivers[i].name) break;
@@ -273,10 +789,18 @@ void usage() {
             cout << ", ";
     }
 
+    cout << endl << "Kinds: ";
+    for (int i = 0;; i++) {
+        if (!kind_names[i].name) break;
+        cout << kind_names[i].name;
+        if (kind_names[i + 1].name)
+            cout << ", ";
+    }
+
     cout << endl;
 }
 
-c2ffi::OutputDriver *select_driver(const std::string &name, std::ostream *os) {
+c2ffi::MakeOutputDriver find_driver(const std::string &name) {
     using namespace c2ffi;
     using namespace std;
 
@@ -284,10 +808,14 @@ c2ffi::OutputDriver *select_driver(const std::string &name, std::ostream *os) {
         if (!OutputDrivers[i].name) break;
 
         if (name == OutputDrivers[i].name)
-            return OutputDrivers[i].fn(os);
+            return OutputDrivers[i].fn;
     }
 
     cerr << "Error: Invalid output driver: " << name << endl;
     usage();
     exit(1);
 }
+
+c2ffi::OutputDriver *select_driver(const std::string &name, std::ostream *os) {
+    return find_driver(name)(os);
+}